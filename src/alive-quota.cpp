@@ -0,0 +1,107 @@
+//
+// alive-quota.cpp
+//
+#include "alive-quota.h"
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory
+{
+aliveQuota::aliveQuota(unsigned long maxAlive,
+                       quotaPolicy policy,
+                       std::chrono::milliseconds timeout,
+                       shedFun shed)
+:
+maxAlive_(maxAlive),
+policy_(policy),
+timeout_(timeout),
+shed_(std::move(shed))
+{
+  if ( (quotaPolicy::shed == policy_) && (nullptr == shed_) )
+  {
+    throw std::invalid_argument("The shed policy needs a shedding function");
+  }
+}
+
+bool
+aliveQuota::tryAcquire() noexcept
+{
+  unsigned long alive {alive_.load()};
+  do
+  {
+    if ( alive >= maxAlive_ )
+    {
+      return false;
+    }
+  } while ( !alive_.compare_exchange_weak(alive, alive + 1) );
+  admitted_.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void
+aliveQuota::acquire()
+{
+  if ( tryAcquire() )
+  {
+    return;
+  }
+
+  switch ( policy_ )
+  {
+    case quotaPolicy::failFast:
+      break;
+
+    case quotaPolicy::block:
+      if ( acquireBlocking() )
+      {
+        return;
+      }
+      break;
+
+    case quotaPolicy::shed:
+      shedCalls_.fetch_add(1, std::memory_order_relaxed);
+      shed_();
+      if ( tryAcquire() )
+      {
+        return;
+      }
+      break;
+  }
+  rejected_.fetch_add(1, std::memory_order_relaxed);
+  throw quotaExceeded("Alive object quota of " + std::to_string(maxAlive_) + " exceeded");
+}
+
+bool
+aliveQuota::acquireBlocking()
+{
+  blocked_.fetch_add(1, std::memory_order_relaxed);
+  // waiters_ is raised before checking for a slot, and release() decrements
+  // alive_ before reading waiters_: with sequentially consistent operations
+  // either the waiter sees the slot or the releaser sees the waiter
+  waiters_.fetch_add(1);
+  std::unique_lock<std::mutex> ul(mtx_);
+  const bool acquired {released_.wait_for(ul, timeout_, [this] () { return tryAcquire(); })};
+  waiters_.fetch_sub(1);
+  return acquired;
+}
+
+void
+aliveQuota::release() noexcept
+{
+  alive_.fetch_sub(1);
+  if ( 0 != waiters_.load() )
+  {
+    // locking orders the notification after the waiter has started waiting
+    { std::lock_guard<std::mutex> lg(mtx_); }
+    released_.notify_one();
+  }
+}
+
+auto
+aliveQuota::getQuotaCounters() const noexcept -> quotaCounters
+{
+  return std::make_tuple(admitted_.load(std::memory_order_relaxed),
+                         rejected_.load(std::memory_order_relaxed),
+                         blocked_.load(std::memory_order_relaxed),
+                         shedCalls_.load(std::memory_order_relaxed),
+                         alive_.load(std::memory_order_relaxed));
+}
+}  // namespace object_factory
@@ -0,0 +1,166 @@
+//
+// alive-quota.h
+//
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include "object-trace.h"
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory
+{
+// thrown when an object can't be created without exceeding its quota
+class quotaExceeded final : public std::runtime_error
+{
+public:
+  explicit
+  quotaExceeded(const std::string& what)
+  :
+  std::runtime_error(what)
+  {}
+};  // class quotaExceeded
+
+enum class quotaPolicy
+{
+  // throw quotaExceeded at once
+  failFast,
+  // wait up to the timeout for an object to be destroyed, then throw
+  block,
+  // call the shedding function, then try once more before throwing
+  shed
+};
+
+//
+// A limit on the number of objects alive, shared by all the objects created
+// through it; one quota per type bounds the memory each type can use under
+// overload.
+//
+// Admission and release are a compare-and-swap and a decrement on one atomic
+// counter. Only blocked creators and, while there are some, the releases
+// waking them up take the mutex of the quota.
+//
+// The quota must outlive all the objects created through it.
+//
+class aliveQuota final
+{
+public:
+  using shedFun = std::function<void(void)>;
+  // admitted, rejected, blocked, shed calls, alive
+  using quotaCounters = std::tuple<unsigned long, unsigned long, unsigned long, unsigned long, unsigned long>;
+
+  aliveQuota(unsigned long maxAlive,
+             quotaPolicy policy = quotaPolicy::failFast,
+             std::chrono::milliseconds timeout = std::chrono::milliseconds::zero(),
+             shedFun shed = nullptr);
+
+  aliveQuota(const aliveQuota& rhs) = delete;
+  aliveQuota& operator=(const aliveQuota& rhs) = delete;
+  aliveQuota(aliveQuota&& rhs) = delete;
+  aliveQuota& operator=(aliveQuota&& rhs) = delete;
+
+  // take a slot for a new object, applying the policy when there is none;
+  // throw quotaExceeded if no slot could be taken
+  void acquire();
+
+  // take a slot if there is one at once
+  bool tryAcquire() noexcept;
+
+  // give back the slot of a destroyed object
+  void release() noexcept;
+
+  unsigned long maxAlive() const noexcept
+  {
+    return maxAlive_;
+  }
+
+  auto getQuotaCounters() const noexcept -> quotaCounters;
+
+private:
+  bool acquireBlocking();
+
+  const unsigned long maxAlive_;
+  const quotaPolicy policy_;
+  const std::chrono::milliseconds timeout_;
+  const shedFun shed_;
+  std::atomic<unsigned long> alive_ {0};
+  std::atomic<unsigned long> waiters_ {0};
+  std::atomic<unsigned long> admitted_ {0};
+  std::atomic<unsigned long> rejected_ {0};
+  std::atomic<unsigned long> blocked_ {0};
+  std::atomic<unsigned long> shedCalls_ {0};
+  std::mutex mtx_ {};
+  std::condition_variable released_ {};
+};  // class aliveQuota
+
+// deleter giving back to the quota the slot of the objects it destroys
+template <typename T>
+class quotaDeleter final
+{
+public:
+  quotaDeleter() noexcept = default;
+
+  explicit
+  quotaDeleter(aliveQuota& quota) noexcept
+  :
+  quota_(&quota)
+  {}
+
+  void operator()(T* object) const noexcept
+  {
+    delete object;
+    if ( nullptr != quota_ )
+    {
+      quota_->release();
+    }
+  }
+
+private:
+  aliveQuota* quota_ {nullptr};
+};  // class quotaDeleter
+
+template <typename T>
+using quotaUniquePtr = std::unique_ptr<T, quotaDeleter<T>>;
+
+template <typename T>
+using quotaObjectFactoryFun = std::function<quotaUniquePtr<T>(void)>;
+
+// create an object of type T within quota; throw quotaExceeded if the quota
+// does not admit it
+template <typename T, typename... Args>
+auto
+createQuotaUniquePtr(aliveQuota& quota, Args&&... args) -> quotaUniquePtr<T>
+{
+  quota.acquire();
+  T* p {nullptr};
+  try
+  {
+    p = new T(args...);
+  }
+  catch (...)
+  {
+    quota.release();
+    throw;
+  }
+  quotaUniquePtr<T> object {p, quotaDeleter<T>(quota)};
+  OBJECT_FACTORY_TRACE(factoryCreate, T, object.get());
+  return object;
+}
+
+template <typename T, typename... Args>
+auto
+createQuotaObjectFactoryFun(aliveQuota& quota, Args&&... args) noexcept -> quotaObjectFactoryFun<T>
+{
+  // the quota must outlive the function object and all the objects it creates
+  return [&quota, args...]()
+         {
+           return createQuotaUniquePtr<T>(quota, args...);
+         };
+}
+}  // namespace object_factory
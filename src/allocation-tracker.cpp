@@ -0,0 +1,167 @@
+//
+// allocation-tracker.cpp
+//
+#include "allocation-tracker.h"
+#include <cstdlib>
+#include <new>
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory::allocation_tracker
+{
+namespace
+{
+// constant initialized: safe to use from operator new at any time
+thread_local allocationCounters threadCounters {0, 0, 0};
+}  // namespace
+
+bool
+trackingEnabled() noexcept
+{
+#if defined(OBJECT_FACTORY_ALLOCATION_TRACKING)
+  return true;
+#else
+  return false;
+#endif
+}
+
+allocationCounters
+threadAllocationCounters() noexcept
+{
+  return threadCounters;
+}
+
+allocationBudget::allocationBudget(unsigned long maxAllocations, std::size_t maxBytes) noexcept
+:
+maxAllocations_(maxAllocations),
+maxBytes_(maxBytes),
+start_(threadCounters)
+{}
+
+unsigned long
+allocationBudget::allocations() const noexcept
+{
+  return threadCounters.allocations_ - start_.allocations_;
+}
+
+unsigned long
+allocationBudget::deallocations() const noexcept
+{
+  return threadCounters.deallocations_ - start_.deallocations_;
+}
+
+std::size_t
+allocationBudget::bytes() const noexcept
+{
+  return threadCounters.bytes_ - start_.bytes_;
+}
+
+bool
+allocationBudget::withinBudget() const noexcept
+{
+  return (allocations() <= maxAllocations_) && (bytes() <= maxBytes_);
+}
+
+void
+allocationBudget::reset() noexcept
+{
+  start_ = threadCounters;
+}
+
+#if defined(OBJECT_FACTORY_ALLOCATION_TRACKING)
+namespace
+{
+void*
+trackedAllocate(std::size_t size, std::size_t alignment) noexcept
+{
+  if ( 0 == size )
+  {
+    size = 1;
+  }
+  void* p {nullptr};
+  if ( alignment <= alignof(std::max_align_t) )
+  {
+    p = std::malloc(size);
+  }
+  else
+  {
+    // aligned_alloc wants the size to be a multiple of the alignment
+    p = std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+  }
+  if ( nullptr != p )
+  {
+    ++threadCounters.allocations_;
+    threadCounters.bytes_ += size;
+  }
+  return p;
+}
+
+void*
+trackedAllocateOrThrow(std::size_t size, std::size_t alignment)
+{
+  for (;;)
+  {
+    void* p {trackedAllocate(size, alignment)};
+    if ( nullptr != p )
+    {
+      return p;
+    }
+    std::new_handler handler {std::get_new_handler()};
+    if ( nullptr == handler )
+    {
+      throw std::bad_alloc();
+    }
+    handler();
+  }
+}
+
+void
+trackedDeallocate(void* p) noexcept
+{
+  if ( nullptr != p )
+  {
+    ++threadCounters.deallocations_;
+    std::free(p);
+  }
+}
+}  // namespace
+#endif
+}  // namespace object_factory::allocation_tracker
+
+#if defined(OBJECT_FACTORY_ALLOCATION_TRACKING)
+// replacements of the global allocation functions; the array and nothrow
+// versions call these ones
+void*
+operator new(std::size_t size)
+{
+  return object_factory::allocation_tracker::trackedAllocateOrThrow(size, alignof(std::max_align_t));
+}
+
+void*
+operator new(std::size_t size, std::align_val_t alignment)
+{
+  return object_factory::allocation_tracker::trackedAllocateOrThrow(size, static_cast<std::size_t>(alignment));
+}
+
+void
+operator delete(void* p) noexcept
+{
+  object_factory::allocation_tracker::trackedDeallocate(p);
+}
+
+void
+operator delete(void* p, [[maybe_unused]] std::size_t size) noexcept
+{
+  object_factory::allocation_tracker::trackedDeallocate(p);
+}
+
+void
+operator delete(void* p, [[maybe_unused]] std::align_val_t alignment) noexcept
+{
+  object_factory::allocation_tracker::trackedDeallocate(p);
+}
+
+void
+operator delete(void* p, [[maybe_unused]] std::size_t size, [[maybe_unused]] std::align_val_t alignment) noexcept
+{
+  object_factory::allocation_tracker::trackedDeallocate(p);
+}
+#endif
@@ -0,0 +1,67 @@
+//
+// allocation-tracker.h
+//
+#pragma once
+
+#include <cstddef>
+#include <limits>
+////////////////////////////////////////////////////////////////////////////////
+//
+// Opt-in tracking of heap allocations.
+//
+// When allocation-tracker.cpp is compiled with OBJECT_FACTORY_ALLOCATION_TRACKING
+// defined it replaces the global operator new and operator delete with hooks
+// counting, per thread, the allocations, deallocations and bytes allocated.
+// Without it nothing is replaced and all the counts stay at zero.
+//
+namespace object_factory::allocation_tracker
+{
+struct allocationCounters
+{
+  unsigned long allocations_;
+  unsigned long deallocations_;
+  std::size_t bytes_;
+};
+
+// true if the operator new/delete hooks are compiled in
+bool trackingEnabled() noexcept;
+
+// the counters of the calling thread since it started
+allocationCounters threadAllocationCounters() noexcept;
+
+//
+// RAII guard measuring the allocations done by the calling thread during its
+// lifetime and checking them against a budget:
+//
+//   allocationBudget budget {1};
+//   auto o = objectFactoryFun();
+//   assert(budget.withinBudget());
+//
+class allocationBudget final
+{
+public:
+  explicit
+  allocationBudget(unsigned long maxAllocations,
+                   std::size_t maxBytes = std::numeric_limits<std::size_t>::max()) noexcept;
+
+  allocationBudget(const allocationBudget& rhs) = delete;
+  allocationBudget& operator=(const allocationBudget& rhs) = delete;
+  allocationBudget(allocationBudget&& rhs) = delete;
+  allocationBudget& operator=(allocationBudget&& rhs) = delete;
+
+  // measured since construction, on the thread that constructed the guard
+  unsigned long allocations() const noexcept;
+  unsigned long deallocations() const noexcept;
+  std::size_t bytes() const noexcept;
+
+  bool withinBudget() const noexcept;
+
+  // restart the measure from now
+  void reset() noexcept;
+
+private:
+  const unsigned long maxAllocations_;
+  const std::size_t maxBytes_;
+  allocationCounters start_;
+};  // class allocationBudget
+}  // namespace object_factory::allocation_tracker
@@ -0,0 +1,285 @@
+//
+// object-factory-benchmark.cpp
+//
+#include "objectFactory.h"
+#include "object-counter.h"
+#include "cow-value.h"
+#include "record-stream.h"
+#include "object-pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+////////////////////////////////////////////////////////////////////////////////
+namespace
+{
+using namespace object_factory;
+using namespace object_factory::object_counter;
+
+// build a table whose construction is expensive compared to copying it
+std::vector<double>
+buildTable(const std::size_t size)
+{
+  std::vector<double> table(size);
+  for (std::size_t i {0}; i < size; ++i)
+  {
+    double x {static_cast<double>(i)};
+    for (int k {0}; k < 4; ++k)
+    {
+      x = std::sin(x) + std::cos(x) * std::sqrt(static_cast<double>(k + 1));
+    }
+    table[i] = x;
+  }
+  return table;
+}
+
+// the heavy member is owned by each object
+class heavy final : public objectCounter<heavy>
+{
+ public:
+  explicit
+  heavy(const std::size_t size)
+  :
+  table_(buildTable(size))
+  {}
+
+  double front() const noexcept
+  {
+    return table_.front();
+  }
+
+ private:
+  std::vector<double> table_;
+};  // class heavy
+
+// the heavy member is shared copy-on-write among copies
+class heavyCow final : public objectCounter<heavyCow>
+{
+ public:
+  explicit
+  heavyCow(const std::size_t size)
+  :
+  table_(buildTable(size))
+  {}
+
+  double front() const noexcept
+  {
+    return table_.get().front();
+  }
+
+ private:
+  cowValue<std::vector<double>> table_;
+};  // class heavyCow
+
+template <typename T>
+void
+runBenchmark(const std::string& name,
+             const objectFactoryFun<T>& factoryFun,
+             const unsigned long objectsToCreate)
+{
+  double sink {0.0};
+  const auto copyConstructions {T::getCopyConstructionsCounter()};
+  const auto start {std::chrono::steady_clock::now()};
+  for (unsigned long i {0}; i < objectsToCreate; ++i)
+  {
+    auto o = factoryFun();
+    sink += o->front();
+  }
+  const auto stop {std::chrono::steady_clock::now()};
+  const auto ns {std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count()};
+
+  std::cout << std::left << std::setw(36) << name
+            << std::right << std::fixed << std::setprecision(1) << std::setw(12)
+            << static_cast<double>(ns) / static_cast<double>(objectsToCreate)
+            << " ns/object"
+            << " - copy constructions " << T::getCopyConstructionsCounter() - copyConstructions
+            << " - (" << sink << ")"
+            << std::endl;
+}
+
+// an object built from a record of a file
+class record final : public objectCounter<record>
+{
+ public:
+  explicit
+  record(std::string_view fields)
+  :
+  id_(fields.substr(0, fields.find(','))),
+  name_(fields.substr(fields.find(',') + 1))
+  {}
+
+  std::size_t size() const noexcept
+  {
+    return id_.size() + name_.size();
+  }
+
+ private:
+  std::string id_;
+  std::string name_;
+};  // class record
+
+// the records written are always this long
+constexpr std::size_t fixedRecordSize {36};
+
+void
+writeRecordFile(const std::string& fileName, const unsigned long records, const recordFormat format)
+{
+  std::ofstream ofs(fileName, std::ios::binary | std::ios::trunc);
+  char fields[fixedRecordSize + 1] {};
+  for (unsigned long i {0}; i < records; ++i)
+  {
+    const int n {std::snprintf(fields, sizeof(fields), "%010lu,name-%020lu", i, i)};
+    if ( recordFormat::lengthPrefixed == format )
+    {
+      const char prefix[4] {static_cast<char>(n), 0, 0, 0};
+      ofs.write(prefix, sizeof(prefix));
+    }
+    ofs.write(fields, n);
+  }
+}
+
+void
+runRecordStreamBenchmark(const std::string& name,
+                         const recordFormat format,
+                         const unsigned long records)
+{
+  const std::string fileName {"/tmp/object-factory-benchmark-records"};
+  writeRecordFile(fileName, records, format);
+
+  std::size_t sink {0};
+  const auto start {std::chrono::steady_clock::now()};
+  recordStreamFactory<record> factory {fileName, format, fixedRecordSize};
+  const std::size_t n {factory.forEachBatch(1'024, [&sink] (std::vector<std::unique_ptr<record>>& batch)
+  {
+    for (auto&& r : batch)
+    {
+      sink += r->size();
+    }
+  })};
+  const auto stop {std::chrono::steady_clock::now()};
+  const auto ns {std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count()};
+  std::remove(fileName.c_str());
+
+  std::cout << std::left << std::setw(36) << name
+            << std::right << std::fixed << std::setprecision(0) << std::setw(12)
+            << static_cast<double>(n) * 1e9 / static_cast<double>(ns)
+            << " records/s"
+            << " - records " << n
+            << " - (" << sink << ")"
+            << std::endl;
+}
+
+// a small object, many of which are alive at once
+class particle final : public objectCounter<particle>
+{
+ public:
+  particle(const double x, const double v) noexcept
+  :
+  x_(x),
+  v_(v)
+  {}
+
+  double x() const noexcept
+  {
+    return x_;
+  }
+
+  void step() noexcept
+  {
+    x_ += v_;
+  }
+
+ private:
+  double x_;
+  double v_;
+};  // class particle
+
+void
+runPoolBenchmark(const std::string& name,
+                 const chunkBacking backing,
+                 const std::size_t objects)
+{
+  objectPool<particle> pool {1, &simulatedNumaNode, 4'096, backing};
+  std::vector<particle*> particles {};
+  particles.reserve(objects);
+
+  const auto start {std::chrono::steady_clock::now()};
+  for (std::size_t i {0}; i < objects; ++i)
+  {
+    particles.push_back(pool.construct(static_cast<double>(i), 1.0));
+  }
+  const auto created {std::chrono::steady_clock::now()};
+
+  // visit the objects in random order: every access is likely to touch a
+  // different page
+  std::shuffle(particles.begin(), particles.end(), std::mt19937_64 {42});
+  const auto shuffled {std::chrono::steady_clock::now()};
+  double sink {0.0};
+  for (auto&& p : particles)
+  {
+    p->step();
+    sink += p->x();
+  }
+  const auto iterated {std::chrono::steady_clock::now()};
+
+  for (auto&& p : particles)
+  {
+    pool.destroy(p);
+  }
+
+  const auto createNs {std::chrono::duration_cast<std::chrono::nanoseconds>(created - start).count()};
+  const auto iterateNs {std::chrono::duration_cast<std::chrono::nanoseconds>(iterated - shuffled).count()};
+  const auto [hugeTLB, transparentHugePages, regular] = pool.getChunkCounters();
+  std::cout << std::left << std::setw(36) << name
+            << std::right << std::fixed << std::setprecision(1) << std::setw(12)
+            << static_cast<double>(createNs) / static_cast<double>(objects)
+            << " ns/create"
+            << std::setw(8)
+            << static_cast<double>(iterateNs) / static_cast<double>(objects)
+            << " ns/visit"
+            << " - chunks hugetlb/thp/regular " << hugeTLB << "/" << transparentHugePages << "/" << regular
+            << " - (" << sink << ")"
+            << std::endl;
+}
+}  // namespace
+
+auto main() -> int
+{
+  const std::size_t tableSize {4'096};
+  const unsigned long objectsToCreate {1'000};
+
+  std::clog << "\n[" << __func__ << "] "
+            << "Object Factory Benchmark STARTED"
+            << std::endl;
+
+  runBenchmark<heavy>("constructor-based factory",
+                      createObjectFactoryFun<heavy>(tableSize),
+                      objectsToCreate);
+  runBenchmark<heavy>("prototype factory",
+                      createPrototypeFactoryFun<heavy>(tableSize),
+                      objectsToCreate);
+  runBenchmark<heavyCow>("constructor-based factory (cow)",
+                         createObjectFactoryFun<heavyCow>(tableSize),
+                         objectsToCreate);
+  runBenchmark<heavyCow>("prototype factory (cow)",
+                         createPrototypeFactoryFun<heavyCow>(tableSize),
+                         objectsToCreate);
+
+  const unsigned long records {1'000'000};
+  runRecordStreamBenchmark("record stream (fixed length)", recordFormat::fixedLength, records);
+  runRecordStreamBenchmark("record stream (length prefixed)", recordFormat::lengthPrefixed, records);
+
+  const std::size_t pooledObjects {8'000'000};
+  runPoolBenchmark("pool (regular chunks)", chunkBacking::regular, pooledObjects);
+  runPoolBenchmark("pool (huge page chunks)", chunkBacking::hugePages, pooledObjects);
+
+  std::clog << "\n[" << __func__ << "] "
+            << "TERMINATED"
+            << std::endl;
+}  // main
@@ -0,0 +1,91 @@
+//
+// counter-context.cpp
+//
+#include "counter-context.h"
+#include <utility>
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory::object_counter
+{
+namespace
+{
+thread_local counterContext* activeContext {nullptr};
+}  // namespace
+
+counterContext::counterContext(std::string name, counterContext* parent)
+:
+name_(std::move(name)),
+parent_(parent)
+{}
+
+auto
+counterContext::getContextCounters() const noexcept -> contextCounters
+{
+  return std::make_tuple(objectsCreated_.load(std::memory_order_relaxed),
+                         objectsDestroyed_.load(std::memory_order_relaxed),
+                         peakNet_.load(std::memory_order_relaxed));
+}
+
+void
+counterContext::resetCounters() noexcept
+{
+  objectsCreated_.store(0, std::memory_order_relaxed);
+  objectsDestroyed_.store(0, std::memory_order_relaxed);
+  net_.store(0, std::memory_order_relaxed);
+  peakNet_.store(0, std::memory_order_relaxed);
+}
+
+void
+counterContext::objectConstructed() noexcept
+{
+  for (counterContext* c {activeContext}; nullptr != c; c = c->parent_)
+  {
+    c->constructed();
+  }
+}
+
+void
+counterContext::objectDestroyed() noexcept
+{
+  for (counterContext* c {activeContext}; nullptr != c; c = c->parent_)
+  {
+    c->destroyed();
+  }
+}
+
+void
+counterContext::constructed() noexcept
+{
+  objectsCreated_.fetch_add(1, std::memory_order_relaxed);
+  const long net {net_.fetch_add(1, std::memory_order_relaxed) + 1};
+  // the peak is only written when it grows, so in steady state this is a load
+  long peak {peakNet_.load(std::memory_order_relaxed)};
+  while ( (net > peak) &&
+          !peakNet_.compare_exchange_weak(peak, net, std::memory_order_relaxed) )
+  {}
+}
+
+void
+counterContext::destroyed() noexcept
+{
+  objectsDestroyed_.fetch_add(1, std::memory_order_relaxed);
+  net_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+counterContext*
+activeCounterContext() noexcept
+{
+  return activeContext;
+}
+
+counterContextScope::counterContextScope(counterContext* context) noexcept
+:
+previousContext_(activeContext)
+{
+  activeContext = context;
+}
+
+counterContextScope::~counterContextScope() noexcept
+{
+  activeContext = previousContext_;
+}
+}  // namespace object_factory::object_counter
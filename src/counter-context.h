@@ -0,0 +1,100 @@
+//
+// counter-context.h
+//
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <tuple>
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory::object_counter
+{
+//
+// A counter context attributes the constructions and destructions of counted
+// objects, of any type, to the piece of work active on the thread running
+// them: a request, a pipeline stage.
+//
+// A thread enters a context with a counterContextScope; scopes nest, and the
+// innermost one is the active context. Each event is counted in the active
+// context and in all its parents, so a stage given its request as parent
+// rolls its counts up into the request.
+//
+// Work handed over to another thread is attributed to the same context by
+// opening a scope there on activeCounterContext() of the submitting thread.
+//
+// A context must outlive the scopes and the children referring to it.
+//
+class counterContext final
+{
+public:
+  // objects created, objects destroyed, peak of created minus destroyed
+  using contextCounters = std::tuple<unsigned long, unsigned long, long>;
+
+  explicit
+  counterContext(std::string name, counterContext* parent = nullptr);
+
+  counterContext(const counterContext& rhs) = delete;
+  counterContext& operator=(const counterContext& rhs) = delete;
+  counterContext(counterContext&& rhs) = delete;
+  counterContext& operator=(counterContext&& rhs) = delete;
+
+  const std::string& name() const noexcept
+  {
+    return name_;
+  }
+
+  counterContext* parent() const noexcept
+  {
+    return parent_;
+  }
+
+  // objects destroyed in this context may have been created elsewhere, so
+  // created minus destroyed can be negative
+  auto getContextCounters() const noexcept -> contextCounters;
+
+  void resetCounters() noexcept;
+
+  // called by objectCounter<T> for every object constructed and destroyed
+  static void objectConstructed() noexcept;
+  static void objectDestroyed() noexcept;
+
+private:
+  void constructed() noexcept;
+  void destroyed() noexcept;
+
+  const std::string name_;
+  counterContext* const parent_;
+  std::atomic<unsigned long> objectsCreated_ {0};
+  std::atomic<unsigned long> objectsDestroyed_ {0};
+  std::atomic<long> net_ {0};
+  std::atomic<long> peakNet_ {0};
+};  // class counterContext
+
+// the context active on the calling thread, nullptr if none
+counterContext* activeCounterContext() noexcept;
+
+// RAII scope making a context the active one of the calling thread; a scope
+// on nullptr suspends the attribution
+class counterContextScope final
+{
+public:
+  explicit
+  counterContextScope(counterContext* context) noexcept;
+
+  explicit
+  counterContextScope(counterContext& context) noexcept
+  :
+  counterContextScope(&context)
+  {}
+
+  ~counterContextScope() noexcept;
+
+  counterContextScope(const counterContextScope& rhs) = delete;
+  counterContextScope& operator=(const counterContextScope& rhs) = delete;
+  counterContextScope(counterContextScope&& rhs) = delete;
+  counterContextScope& operator=(counterContextScope&& rhs) = delete;
+
+private:
+  counterContext* const previousContext_;
+};  // class counterContextScope
+}  // namespace object_factory::object_counter
@@ -0,0 +1,115 @@
+//
+// cow-value.h
+//
+#pragma once
+
+#include <atomic>
+#include <utility>
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory
+{
+//
+// A copy-on-write holder for a heavy member of an object.
+//
+// Copies of a cowValue share the same V until one of them is written through
+// write(), which first clones V if it is shared. Objects cloned from a
+// prototype can then share their immutable heavy members with it.
+//
+// Reading through get() is safe from any thread; write() must not race with
+// copies of the same cowValue, as for any non-const member function.
+//
+// The sharing is counted by an own atomic reference count rather than by
+// shared_ptr::use_count(), which is a relaxed load: write() mutates V in place
+// only after an acquire load has seen the count at 1, so the reads of V made
+// by the copies already destroyed on other threads happen before the write.
+//
+// A moved-from cowValue can only be assigned to or destroyed.
+//
+template <typename V>
+class cowValue final
+{
+public:
+  explicit
+  cowValue(V value)
+  :
+  shared_(new sharedValue(std::move(value)))
+  {}
+
+  cowValue(const cowValue& rhs) noexcept
+  :
+  shared_(rhs.shared_)
+  {
+    // a new reference is taken from an existing one: nothing to order
+    shared_->refs_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  cowValue(cowValue&& rhs) noexcept
+  :
+  shared_(std::exchange(rhs.shared_, nullptr))
+  {}
+
+  cowValue& operator=(const cowValue& rhs) noexcept
+  {
+    cowValue copy(rhs);
+    std::swap(shared_, copy.shared_);
+    return *this;
+  }
+
+  cowValue& operator=(cowValue&& rhs) noexcept
+  {
+    std::swap(shared_, rhs.shared_);
+    return *this;
+  }
+
+  ~cowValue()
+  {
+    release();
+  }
+
+  const V& get() const noexcept
+  {
+    return shared_->value_;
+  }
+
+  V& write()
+  {
+    if ( isShared() )
+    {
+      sharedValue* clone {new sharedValue(std::as_const(shared_->value_))};
+      release();
+      shared_ = clone;
+    }
+    return shared_->value_;
+  }
+
+  bool isShared() const noexcept
+  {
+    return shared_->refs_.load(std::memory_order_acquire) > 1;
+  }
+
+private:
+  struct sharedValue
+  {
+    explicit
+    sharedValue(V value)
+    :
+    value_(std::move(value))
+    {}
+
+    std::atomic<long> refs_ {1};
+    V value_;
+  };  // struct sharedValue
+
+  // the last reference acquires the releases of the others before deleting
+  void release() noexcept
+  {
+    if ( (nullptr != shared_) && (1 == shared_->refs_.fetch_sub(1, std::memory_order_acq_rel)) )
+    {
+      delete shared_;
+    }
+    shared_ = nullptr;
+  }
+
+  sharedValue* shared_;
+};  // class cowValue
+}  // namespace object_factory
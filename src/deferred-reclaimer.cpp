@@ -0,0 +1,107 @@
+//
+// deferred-reclaimer.cpp
+//
+#include "deferred-reclaimer.h"
+#include <algorithm>
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory
+{
+deferredReclaimer::deferredReclaimer(std::size_t maxQueueDepth)
+:
+maxQueueDepth_(std::max<std::size_t>(maxQueueDepth, 1)),
+reclaimer_()
+{
+  // reserve up front so that retire() never allocates
+  queue_.reserve(maxQueueDepth_);
+  reclaimer_ = std::thread(&deferredReclaimer::reclaimLoop, this);
+}
+
+deferredReclaimer::~deferredReclaimer() noexcept
+{
+  {
+    std::lock_guard<std::mutex> lg(mtx_);
+    stop_ = true;
+  }
+  workAvailable_.notify_one();
+  reclaimer_.join();
+}
+
+void
+deferredReclaimer::retire(void* object, destroyFun destroy) noexcept
+{
+  if ( nullptr == object )
+  {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lg(mtx_);
+    ++retired_;
+    if ( queue_.size() < maxQueueDepth_ )
+    {
+      queue_.push_back({object, destroy});
+      maxQueueDepthObserved_ = std::max(maxQueueDepthObserved_, queue_.size());
+      if ( 1 == queue_.size() )
+      {
+        workAvailable_.notify_one();
+      }
+      return;
+    }
+    ++inlineDestructions_;
+  }
+  // queue full: apply backpressure by destroying the object here
+  destroy(object);
+  std::lock_guard<std::mutex> lg(mtx_);
+  ++reclaimed_;
+}
+
+void
+deferredReclaimer::drain() noexcept
+{
+  std::unique_lock<std::mutex> ul(mtx_);
+  drained_.wait(ul, [this] () { return queue_.empty() && !reclaiming_; });
+}
+
+auto
+deferredReclaimer::getReclaimerCounters() const noexcept -> reclaimerCounters
+{
+  std::lock_guard<std::mutex> lg(mtx_);
+  return std::make_tuple(retired_, reclaimed_, inlineDestructions_, maxQueueDepthObserved_);
+}
+
+void
+deferredReclaimer::reclaimLoop() noexcept
+{
+  // objects are destroyed in batches outside the lock; batch and queue_ swap
+  // their buffers, so after the first round no allocation happens here either
+  std::vector<retiredObject> batch {};
+  batch.reserve(maxQueueDepth_);
+
+  std::unique_lock<std::mutex> ul(mtx_);
+  for (;;)
+  {
+    workAvailable_.wait(ul, [this] () { return stop_ || !queue_.empty(); });
+    if ( queue_.empty() )
+    {
+      // stop_ is set and nothing is left to reclaim
+      break;
+    }
+    batch.swap(queue_);
+    reclaiming_ = true;
+    ul.unlock();
+
+    for (auto&& item : batch)
+    {
+      item.destroy_(item.object_);
+    }
+
+    ul.lock();
+    reclaimed_ += batch.size();
+    batch.clear();
+    reclaiming_ = false;
+    if ( queue_.empty() )
+    {
+      drained_.notify_all();
+    }
+  }
+}
+}  // namespace object_factory
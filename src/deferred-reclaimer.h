@@ -0,0 +1,157 @@
+//
+// deferred-reclaimer.h
+//
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include "object-trace.h"
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory
+{
+//
+// A deferredReclaimer owns a background thread that destroys the objects
+// retired to it, so the thread dropping the last reference to an object does
+// not pay for the destructor and the deallocation.
+//
+// The queue of retired objects is bounded by maxQueueDepth: when it is full
+// the retiring thread destroys the object inline instead of waiting, so memory
+// held by retired objects is bounded too.
+//
+class deferredReclaimer final
+{
+public:
+  using destroyFun = void (*)(void*) noexcept;
+  // retired, reclaimed, inline destructions, max queue depth observed
+  using reclaimerCounters = std::tuple<unsigned long, unsigned long, unsigned long, std::size_t>;
+
+  explicit
+  deferredReclaimer(std::size_t maxQueueDepth = 1'024);
+
+  // all the objects still queued are destroyed before returning
+  ~deferredReclaimer() noexcept;
+
+  deferredReclaimer(const deferredReclaimer& rhs) = delete;
+  deferredReclaimer& operator=(const deferredReclaimer& rhs) = delete;
+  deferredReclaimer(deferredReclaimer&& rhs) = delete;
+  deferredReclaimer& operator=(deferredReclaimer&& rhs) = delete;
+
+  // queue object for deferred destruction by destroy; if the queue is full
+  // destroy is called inline
+  void retire(void* object, destroyFun destroy) noexcept;
+
+  // block until all the objects retired so far have been destroyed
+  void drain() noexcept;
+
+  auto getReclaimerCounters() const noexcept -> reclaimerCounters;
+
+private:
+  struct retiredObject
+  {
+    void* object_;
+    destroyFun destroy_;
+  };
+
+  void reclaimLoop() noexcept;
+
+  const std::size_t maxQueueDepth_;
+  mutable std::mutex mtx_ {};
+  std::condition_variable workAvailable_ {};
+  std::condition_variable drained_ {};
+  std::vector<retiredObject> queue_ {};
+  bool reclaiming_ {false};
+  bool stop_ {false};
+  unsigned long retired_ {0};
+  unsigned long reclaimed_ {0};
+  unsigned long inlineDestructions_ {0};
+  std::size_t maxQueueDepthObserved_ {0};
+  // must be the last data member: the thread starts in the ctor
+  std::thread reclaimer_;
+};  // class deferredReclaimer
+
+// true if T exposes the retirement hooks of objectCounter<T>
+template <typename T, typename = void>
+struct isRetirementAware : std::false_type
+{};
+
+template <typename T>
+struct isRetirementAware<T, std::void_t<decltype(T::objectRetired()),
+                                        decltype(T::retiredObjectReclaimed())>> : std::true_type
+{};
+
+// deleter handing objects over to a deferredReclaimer; a default constructed
+// deleter has no reclaimer and destroys the objects inline
+template <typename T>
+class deferredDeleter final
+{
+public:
+  deferredDeleter() noexcept = default;
+
+  explicit
+  deferredDeleter(deferredReclaimer& reclaimer) noexcept
+  :
+  reclaimer_(&reclaimer)
+  {}
+
+  void operator()(T* object) const noexcept
+  {
+    if constexpr ( isRetirementAware<T>::value )
+    {
+      T::objectRetired();
+    }
+    if ( nullptr == reclaimer_ )
+    {
+      destroy(object);
+      return;
+    }
+    reclaimer_->retire(object, &deferredDeleter<T>::destroy);
+  }
+
+private:
+  static
+  void
+  destroy(void* object) noexcept
+  {
+    if constexpr ( isRetirementAware<T>::value )
+    {
+      T::retiredObjectReclaimed();
+    }
+    delete static_cast<T*>(object);
+  }
+
+  deferredReclaimer* reclaimer_ {nullptr};
+};  // class deferredDeleter
+
+template <typename T>
+using deferredUniquePtr = std::unique_ptr<T, deferredDeleter<T>>;
+
+template <typename T>
+using deferredObjectFactoryFun = std::function<deferredUniquePtr<T>(void)>;
+
+// create an object of type T whose destruction is deferred to reclaimer
+template <typename T, typename... Args>
+auto
+createDeferredUniquePtr(deferredReclaimer& reclaimer, Args&&... args) -> deferredUniquePtr<T>
+{
+  deferredUniquePtr<T> object {new T(args...), deferredDeleter<T>(reclaimer)};
+  OBJECT_FACTORY_TRACE(factoryCreate, T, object.get());
+  return object;
+}
+
+template <typename T, typename... Args>
+auto
+createDeferredObjectFactoryFun(deferredReclaimer& reclaimer, Args&&... args) noexcept -> deferredObjectFactoryFun<T>
+{
+  // the reclaimer must outlive the function object and all the objects it creates
+  return [&reclaimer, args...]()
+         {
+           return createDeferredUniquePtr<T>(reclaimer, args...);
+         };
+}
+}  // namespace object_factory
@@ -0,0 +1,202 @@
+//
+// inline-poly.h
+//
+#pragma once
+
+#include "object-trace.h"
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory
+{
+//
+// A move-only owning handle to an object of a type derived from Base, with
+// small object optimization: derived objects up to N bytes, aligned at most
+// to Align and move constructible, are stored inline in the handle; larger
+// ones are allocated on the heap.
+//
+// An inline object is moved with its own move constructor when the handle is
+// moved, and destroyed as its own type: Base needs no virtual destructor.
+// For counted types this shows up as a move construction and a destruction
+// in objectCounter<Derived>, exactly as for any other moved object.
+//
+template <typename Base, std::size_t N, std::size_t Align = alignof(std::max_align_t)>
+class inlinePoly final
+{
+public:
+  // true if a Derived is stored inline
+  template <typename Derived>
+  static constexpr bool fitsInline {(sizeof(Derived) <= N) &&
+                                    (alignof(Derived) <= Align) &&
+                                    std::is_move_constructible_v<Derived>};
+
+  inlinePoly() noexcept = default;
+
+  template <typename Derived, typename... Args>
+  explicit
+  inlinePoly(std::in_place_type_t<Derived>, Args&&... args)
+  {
+    static_assert(std::is_base_of_v<Base, Derived>, "Derived must derive from Base");
+    if constexpr ( fitsInline<Derived> )
+    {
+      ptr_ = ::new (static_cast<void*>(storage_)) Derived(std::forward<Args>(args)...);
+      ops_ = &inlineOps<Derived>;
+    }
+    else
+    {
+      Derived* object {new Derived(std::forward<Args>(args)...)};
+      ::new (static_cast<void*>(storage_)) Derived*(object);
+      ptr_ = object;
+      ops_ = &heapOps<Derived>;
+    }
+  }
+
+  inlinePoly(inlinePoly&& rhs)
+  {
+    moveFrom(rhs);
+  }
+
+  inlinePoly& operator=(inlinePoly&& rhs)
+  {
+    if ( this != &rhs )
+    {
+      reset();
+      moveFrom(rhs);
+    }
+    return *this;
+  }
+
+  inlinePoly(const inlinePoly& rhs) = delete;
+  inlinePoly& operator=(const inlinePoly& rhs) = delete;
+
+  ~inlinePoly() noexcept
+  {
+    reset();
+  }
+
+  void reset() noexcept
+  {
+    if ( nullptr != ops_ )
+    {
+      ops_->destroy_(storage_);
+      ops_ = nullptr;
+      ptr_ = nullptr;
+    }
+  }
+
+  Base* get() const noexcept
+  {
+    return ptr_;
+  }
+
+  Base* operator->() const noexcept
+  {
+    return ptr_;
+  }
+
+  Base& operator*() const noexcept
+  {
+    return *ptr_;
+  }
+
+  explicit operator bool() const noexcept
+  {
+    return nullptr != ptr_;
+  }
+
+  bool isInline() const noexcept
+  {
+    return (nullptr != ops_) && ops_->inline_;
+  }
+
+private:
+  struct operations
+  {
+    // move construct the object stored in src into dst and destroy it in src;
+    // return the Base of the object in dst
+    Base* (*moveTo_)(void* src, void* dst);
+    void (*destroy_)(void* storage) noexcept;
+    bool inline_;
+  };
+
+  template <typename Derived>
+  static
+  Base*
+  inlineMoveTo(void* src, void* dst)
+  {
+    Derived* source {std::launder(static_cast<Derived*>(src))};
+    Derived* object {::new (dst) Derived(std::move(*source))};
+    source->~Derived();
+    return object;
+  }
+
+  template <typename Derived>
+  static
+  void
+  inlineDestroy(void* storage) noexcept
+  {
+    std::launder(static_cast<Derived*>(storage))->~Derived();
+  }
+
+  template <typename Derived>
+  static
+  Base*
+  heapMoveTo(void* src, void* dst)
+  {
+    Derived* object {*std::launder(static_cast<Derived**>(src))};
+    ::new (dst) Derived*(object);
+    return object;
+  }
+
+  template <typename Derived>
+  static
+  void
+  heapDestroy(void* storage) noexcept
+  {
+    delete *std::launder(static_cast<Derived**>(storage));
+  }
+
+  template <typename Derived>
+  static constexpr operations inlineOps {&inlineMoveTo<Derived>, &inlineDestroy<Derived>, true};
+
+  template <typename Derived>
+  static constexpr operations heapOps {&heapMoveTo<Derived>, &heapDestroy<Derived>, false};
+
+  void moveFrom(inlinePoly& rhs)
+  {
+    if ( nullptr != rhs.ops_ )
+    {
+      ptr_ = rhs.ops_->moveTo_(rhs.storage_, storage_);
+      ops_ = rhs.ops_;
+      rhs.ops_ = nullptr;
+      rhs.ptr_ = nullptr;
+    }
+  }
+
+  // large enough and aligned for the Derived* of heap objects too
+  alignas((Align < alignof(void*)) ? alignof(void*) : Align)
+  unsigned char storage_[(N < sizeof(void*)) ? sizeof(void*) : N];
+  const operations* ops_ {nullptr};
+  Base* ptr_ {nullptr};
+};  // class inlinePoly
+
+template <typename Base, std::size_t N>
+using inlinePolyFactoryFun = std::function<inlinePoly<Base, N>(void)>;
+
+template <typename Base, std::size_t N, typename Derived, typename... Args>
+auto
+createInlinePolyFactoryFun(Args&&... args) noexcept -> inlinePolyFactoryFun<Base, N>
+{
+  // return a function object creating Derived's with the given arguments,
+  // stored inline in the handle if they fit
+  return [args...]()
+         {
+           inlinePoly<Base, N> object {std::in_place_type<Derived>, args...};
+           OBJECT_FACTORY_TRACE(factoryCreate, Derived, object.get());
+           return object;
+         };
+}
+}  // namespace object_factory
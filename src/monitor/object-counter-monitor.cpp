@@ -0,0 +1,88 @@
+//
+// object-counter-monitor.cpp
+//
+// Attach to the shared memory segment a process exports its object counters
+// to and print them:
+//
+//   object-counter-monitor <segment name> [interval ms]
+//
+// With no interval the counters are printed once.
+//
+#include "shared-counters.h"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+////////////////////////////////////////////////////////////////////////////////
+namespace
+{
+using namespace object_factory::object_counter;
+
+void
+printCounters(const std::string& segmentName)
+{
+  const std::vector<sharedCounterSnapshot> snapshots {readSharedCounters(segmentName)};
+
+  std::cout << std::left << std::setw(32) << "type"
+            << std::right
+            << std::setw(14) << "created"
+            << std::setw(14) << "alive"
+            << std::setw(14) << "destroyed"
+            << std::setw(10) << "retired"
+            << std::setw(12) << "copy-ctor"
+            << std::setw(12) << "copy-asgn"
+            << std::setw(12) << "move-ctor"
+            << std::setw(12) << "move-asgn"
+            << std::setw(6) << "TMDs"
+            << '\n';
+  for (auto&& s : snapshots)
+  {
+    std::cout << std::left << std::setw(32) << s.typeName_
+              << std::right
+              << std::setw(14) << s.values_[objectsCreatedIndex]
+              << std::setw(14) << s.values_[objectsAliveIndex]
+              << std::setw(14) << s.values_[objectsDestroyedIndex]
+              << std::setw(10) << s.values_[objectsRetiredIndex]
+              << std::setw(12) << s.values_[copyConstructionsIndex]
+              << std::setw(12) << s.values_[copyAssignmentsIndex]
+              << std::setw(12) << s.values_[moveConstructionsIndex]
+              << std::setw(12) << s.values_[moveAssignmentsIndex]
+              << std::setw(6) << ((0 != s.values_[tooManyDestructionsIndex]) ? "yes" : "no")
+              << '\n';
+  }
+  std::cout << std::endl;
+}
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int
+{
+  if ( (argc < 2) || (argc > 3) )
+  {
+    std::cerr << "usage: " << argv[0] << " <segment name> [interval ms]\n";
+    return 1;
+  }
+  const std::string segmentName {argv[1]};
+
+  try
+  {
+    if ( 2 == argc )
+    {
+      printCounters(segmentName);
+      return 0;
+    }
+    const std::chrono::milliseconds interval {std::stoul(argv[2])};
+    for (;;)
+    {
+      printCounters(segmentName);
+      std::this_thread::sleep_for(interval);
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "[" << __func__ << "] "
+              << "EXCEPTION: "
+              << e.what()
+              << '\n';
+    return 1;
+  }
+}  // main
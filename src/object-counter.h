@@ -5,8 +5,14 @@
 //
 #pragma once
 
+#include <atomic>
 #include <tuple>
 #include <mutex>
+#include <stdexcept>
+#include "counter-context.h"
+#include "object-trace.h"
+#include "shared-counters.h"
+#include "thread-matrix.h"
 ////////////////////////////////////////////////////////////////////////////////
 namespace object_factory::object_counter
 {
@@ -22,64 +28,90 @@ namespace object_factory::object_counter
 //
 // counterType, the type of the counters, MUST be unsigned
 // counterType's type is unsigned long by default
-template <typename T, typename counterType = unsigned long>
-class objectCounter
+//
+// Writers are serialized by a mutex and publish their updates through a
+// sequence lock: readers never take the mutex and never block writers, they
+// just retry in the rare case a writer updated the counters while they read.
+//
+// Constructions and destructions are also counted in the counterContext
+// active on the calling thread, if any.
+//
+// With trackThreads true each object stores the index of the thread that
+// created it, and its destruction is counted in a creator -> destroyer thread
+// matrix of T, read with getThreadMatrix(); with the default false the
+// objects store nothing more.
+template <typename T, typename counterType = unsigned long, bool trackThreads = false>
+class objectCounter : public creatorThread<trackThreads>
 {
 public:
   using objectCounters = std::tuple<counterType, counterType, counterType, bool>;
   using copyMoveCounters = std::tuple<counterType, counterType, counterType, counterType>;
+  // objectCounters followed by copyMoveCounters
+  using allCounters = std::tuple<counterType, counterType, counterType, bool,
+                                 counterType, counterType, counterType, counterType>;
 
   // default ctor
   objectCounter() noexcept(false)
   {
-    std::lock_guard<std::mutex> lg(mtx_);
-    ++objectsCreated_;
-    ++objectsAlive_;
+    OBJECT_FACTORY_TRACE(construction, T, this);
+    writeSection ws {};
+    increment(objectsCreated_);
+    increment(objectsAlive_);
     if ( checkCounterOverflow() )
     {
       throw std::overflow_error("Object Counters in OVERFLOW");
     }
+    counterContext::objectConstructed();
   }
 
   // copy ctor
   objectCounter([[maybe_unused]]const objectCounter& rhs) noexcept(false)
+  :
+  // a copy is a new object, created by the calling thread
+  creatorThread<trackThreads>()
   {
-    std::lock_guard<std::mutex> lg(mtx_);
-    ++copyConstructions_;
-    ++objectsCreated_;
-    ++objectsAlive_;
+    OBJECT_FACTORY_TRACE(copyConstruction, T, this);
+    writeSection ws {};
+    increment(copyConstructions_);
+    increment(objectsCreated_);
+    increment(objectsAlive_);
     if ( checkCounterOverflow() )
     {
       throw std::overflow_error("Object Counters in OVERFLOW");
     }
+    counterContext::objectConstructed();
   }
 
   // copy assignment operator=
   objectCounter& operator=([[maybe_unused]] const objectCounter& rhs)
   {
-    std::lock_guard<std::mutex> lg(mtx_);
-    ++copyAssignments_;
+    OBJECT_FACTORY_TRACE(copyAssignment, T, this);
+    writeSection ws {};
+    increment(copyAssignments_);
     return *this;
   }
 
   // move ctor
   objectCounter([[maybe_unused]] objectCounter&& rhs)
   {
-    std::lock_guard<std::mutex> lg(mtx_);
-    ++moveConstructions_;
-    ++objectsCreated_;
-    ++objectsAlive_;
+    OBJECT_FACTORY_TRACE(moveConstruction, T, this);
+    writeSection ws {};
+    increment(moveConstructions_);
+    increment(objectsCreated_);
+    increment(objectsAlive_);
     if ( checkCounterOverflow() )
     {
       throw std::overflow_error("Object Counters in OVERFLOW");
     }
+    counterContext::objectConstructed();
   }
 
   // move assignment operator=
   objectCounter& operator=([[maybe_unused]] objectCounter&& rhs)
   {
-    std::lock_guard<std::mutex> lg(mtx_);
-    ++moveAssignments_;
+    OBJECT_FACTORY_TRACE(moveAssignment, T, this);
+    writeSection ws {};
+    increment(moveAssignments_);
     return *this;
   }
 
@@ -87,16 +119,21 @@ public:
   virtual
   ~objectCounter() noexcept
   {
-    std::lock_guard<std::mutex> lg(mtx_);
-    if (   (0 == objectsAlive_) // must be non-zero since we destroy an object
-           || (objectsCreated_ != (objectsAlive_ + objectsDestroyed_)) )
+    OBJECT_FACTORY_TRACE(destruction, T, this);
+    counterContext::objectDestroyed();
+    if constexpr ( trackThreads )
     {
-      tooManyDestructions_ = true;
+      threadMatrix_.record(this->creatorIndex(), trackedThreadIndex());
+    }
+    writeSection ws {};
+    if ( checkCounterOverflow() ) // alive must be non-zero since we destroy an object
+    {
+      tooManyDestructions_.store(true, std::memory_order_relaxed);
     }
     else
     {
-      --objectsAlive_;
-      ++objectsDestroyed_;
+      decrement(objectsAlive_);
+      increment(objectsDestroyed_);
     }
   }
 
@@ -104,144 +141,354 @@ public:
   counterType
   getObjectsCreatedCounter() noexcept
   {
-    std::lock_guard<std::mutex> lg(mtx_);
-    return objectsCreated_;
+    return objectsCreated_.load(std::memory_order_relaxed);
   }
 
   static
   counterType
   getObjectsAliveCounter() noexcept
   {
-    std::lock_guard<std::mutex> lg(mtx_);
-    return objectsAlive_;
+    return objectsAlive_.load(std::memory_order_relaxed);
   }
 
   static
   counterType
   getObjectsDestroyedCounter() noexcept
   {
-    std::lock_guard<std::mutex> lg(mtx_);
-    return objectsDestroyed_;
+    return objectsDestroyed_.load(std::memory_order_relaxed);
   }
 
   static
   bool
   getTooManyDestructionsFlag() noexcept
   {
-    std::lock_guard<std::mutex> lg(mtx_);
-    return tooManyDestructions_;
+    return tooManyDestructions_.load(std::memory_order_relaxed);
   }
 
   static
   counterType
   getCopyConstructionsCounter() noexcept
   {
-    std::lock_guard<std::mutex> lg(mtx_);
-    return copyConstructions_;
+    return copyConstructions_.load(std::memory_order_relaxed);
   }
 
   static
   counterType
   getCopyAssignmentsCounter() noexcept
   {
-    std::lock_guard<std::mutex> lg(mtx_);
-    return copyAssignments_;
+    return copyAssignments_.load(std::memory_order_relaxed);
   }
 
   static
   counterType
   getMoveConstructionsCounter() noexcept
   {
-    std::lock_guard<std::mutex> lg(mtx_);
-    return moveConstructions_;
+    return moveConstructions_.load(std::memory_order_relaxed);
   }
 
   static
   counterType
   getMoveAssignmentsCounter() noexcept
   {
-    std::lock_guard<std::mutex> lg(mtx_);
-    return moveAssignments_;
+    return moveAssignments_.load(std::memory_order_relaxed);
+  }
+
+  // the number of objects handed over to a deferredReclaimer and still waiting
+  // to be destroyed; they are still counted as alive until their dtor runs
+  static
+  counterType
+  getObjectsRetiredCounter() noexcept
+  {
+    return objectsRetired_.load(std::memory_order_relaxed);
+  }
+
+  // called by deferredDeleter<T> when an object is retired
+  static
+  void
+  objectRetired() noexcept
+  {
+    objectsRetired_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // called by deferredDeleter<T> right before a retired object is destroyed
+  static
+  void
+  retiredObjectReclaimed() noexcept
+  {
+    objectsRetired_.fetch_sub(1, std::memory_order_relaxed);
   }
 
   static
   auto
   getObjectCounters() noexcept -> objectCounters
   {
-    std::lock_guard<std::mutex> lg(mtx_);
-    return std::make_tuple(objectsCreated_, objectsAlive_, objectsDestroyed_, tooManyDestructions_);
+    return readConsistent([] () noexcept
+                          {
+                            return std::make_tuple(load(objectsCreated_),
+                                                   load(objectsAlive_),
+                                                   load(objectsDestroyed_),
+                                                   tooManyDestructions_.load(std::memory_order_relaxed));
+                          });
   }
   static
   auto
   getCopyMoveCounters() noexcept -> copyMoveCounters
   {
-    std::lock_guard<std::mutex> lg(mtx_);
-    return std::make_tuple(copyConstructions_, copyAssignments_, moveConstructions_, moveAssignments_);
+    return readConsistent([] () noexcept
+                          {
+                            return std::make_tuple(load(copyConstructions_),
+                                                   load(copyAssignments_),
+                                                   load(moveConstructions_),
+                                                   load(moveAssignments_));
+                          });
+  }
+
+  // all the counters in a single consistent snapshot
+  static
+  auto
+  getAllCounters() noexcept -> allCounters
+  {
+    return readConsistent([] () noexcept
+                          {
+                            return std::make_tuple(load(objectsCreated_),
+                                                   load(objectsAlive_),
+                                                   load(objectsDestroyed_),
+                                                   tooManyDestructions_.load(std::memory_order_relaxed),
+                                                   load(copyConstructions_),
+                                                   load(copyAssignments_),
+                                                   load(moveConstructions_),
+                                                   load(moveAssignments_));
+                          });
+  }
+
+  // export the counters to a slot named typeName in segment, where processes
+  // attached to it can read them; the slot is refreshed at each update of the
+  // counters, the retired counter at the next update of the others; the
+  // export stops by itself when the segment is destroyed
+  static
+  void
+  exportToSharedMemory(sharedCounterSegment& segment, const std::string& typeName)
+  {
+    sharedCounterSlot* slot {segment.allocateSlot(typeName, &detachSharedSlot)};
+    writeSection ws {};
+    sharedSlot_.store(slot, std::memory_order_relaxed);
   }
 
+  static
+  void
+  stopSharedMemoryExport() noexcept
+  {
+    writeSection ws {};
+    sharedSlot_.store(nullptr, std::memory_order_relaxed);
+  }
+
+  // the creator -> destroyer thread matrix of T; available only when
+  // trackThreads is true
+  static
+  threadMatrixSnapshot
+  getThreadMatrix()
+  {
+    static_assert(trackThreads, "Thread tracking is off for this type");
+    return threadMatrix_.snapshot();
+  }
+
+  // the retired counter is left alone: it counts the objects still queued in
+  // a deferredReclaimer, which are reclaimed after the reset
   static
   void
   resetCounters() noexcept
   {
-    std::lock_guard<std::mutex> lg(mtx_);
-    objectsCreated_ = 0;
-    objectsAlive_ = 0;
-    objectsDestroyed_ = 0;
-    copyConstructions_ = 0;
-    copyAssignments_ = 0;
-    moveConstructions_ = 0;
-    moveAssignments_ = 0;
-    tooManyDestructions_ = false;
+    writeSection ws {};
+    objectsCreated_.store(0, std::memory_order_relaxed);
+    objectsAlive_.store(0, std::memory_order_relaxed);
+    objectsDestroyed_.store(0, std::memory_order_relaxed);
+    copyConstructions_.store(0, std::memory_order_relaxed);
+    copyAssignments_.store(0, std::memory_order_relaxed);
+    moveConstructions_.store(0, std::memory_order_relaxed);
+    moveAssignments_.store(0, std::memory_order_relaxed);
+    tooManyDestructions_.store(false, std::memory_order_relaxed);
+    if constexpr ( trackThreads )
+    {
+      threadMatrix_.reset();
+    }
   }
 
 protected:
   // in a multithreaded process threads can allocate objects of the same class,
-  // so static data must be protected with a mutex
+  // so updates to static data must be serialized with a mutex; the counters
+  // are atomic so that readers can load them without taking it
   static std::mutex mtx_;
-  static counterType objectsCreated_;
-  static counterType objectsAlive_;
-  static counterType objectsDestroyed_;
-  static counterType copyConstructions_;
-  static counterType copyAssignments_;
-  static counterType moveConstructions_;
-  static counterType moveAssignments_;
-  static bool tooManyDestructions_;
+  // odd while a writer is updating the counters
+  static std::atomic<unsigned long> seq_;
+  static std::atomic<counterType> objectsCreated_;
+  static std::atomic<counterType> objectsAlive_;
+  static std::atomic<counterType> objectsDestroyed_;
+  static std::atomic<counterType> objectsRetired_;
+  static std::atomic<counterType> copyConstructions_;
+  static std::atomic<counterType> copyAssignments_;
+  static std::atomic<counterType> moveConstructions_;
+  static std::atomic<counterType> moveAssignments_;
+  static std::atomic<bool> tooManyDestructions_;
+  // where the counters are exported to, if they are
+  static std::atomic<sharedCounterSlot*> sharedSlot_;
+  // instantiated only when trackThreads is true
+  static threadMatrix<counterType> threadMatrix_;
 
 private:
-  static constexpr
+  // scope of a writer: holds mtx_ and keeps seq_ odd
+  class writeSection final
+  {
+  public:
+    writeSection() noexcept
+    :
+    lg_(mtx_)
+    {
+      seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    ~writeSection() noexcept
+    {
+      publishShared();
+      seq_.store(seq_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    writeSection(const writeSection& rhs) = delete;
+    writeSection& operator=(const writeSection& rhs) = delete;
+    writeSection(writeSection&& rhs) = delete;
+    writeSection& operator=(writeSection&& rhs) = delete;
+
+  private:
+    std::lock_guard<std::mutex> lg_;
+  };  // class writeSection
+
+  // writers hold mtx_, so a plain load and store is enough to update a counter
+  static
+  void
+  increment(std::atomic<counterType>& counter) noexcept
+  {
+    counter.store(static_cast<counterType>(counter.load(std::memory_order_relaxed) + 1),
+                  std::memory_order_relaxed);
+  }
+
+  static
+  void
+  decrement(std::atomic<counterType>& counter) noexcept
+  {
+    counter.store(static_cast<counterType>(counter.load(std::memory_order_relaxed) - 1),
+                  std::memory_order_relaxed);
+  }
+
+  static
+  counterType
+  load(const std::atomic<counterType>& counter) noexcept
+  {
+    return counter.load(std::memory_order_relaxed);
+  }
+
+  // retry read until no writer updated the counters while it was running
+  template <typename F>
+  static
+  auto
+  readConsistent(F read) noexcept
+  {
+    for (;;)
+    {
+      const unsigned long before {seq_.load(std::memory_order_acquire)};
+      if ( 0 != (before & 1) )
+      {
+        continue;
+      }
+      const auto counters {read()};
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if ( before == seq_.load(std::memory_order_relaxed) )
+      {
+        return counters;
+      }
+    }
+  }
+
+  // called by the segment of slot when it is destroyed; the counters may have
+  // been exported elsewhere since
+  static
+  void
+  detachSharedSlot(sharedCounterSlot* slot) noexcept
+  {
+    writeSection ws {};
+    if ( slot == sharedSlot_.load(std::memory_order_relaxed) )
+    {
+      sharedSlot_.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  // called by writers holding mtx_
+  static
+  void
+  publishShared() noexcept
+  {
+    sharedCounterSlot* slot {sharedSlot_.load(std::memory_order_relaxed)};
+    if ( nullptr == slot )
+    {
+      return;
+    }
+    const std::uint64_t values[sharedCounterCount] {load(objectsCreated_),
+                                                    load(objectsAlive_),
+                                                    load(objectsDestroyed_),
+                                                    tooManyDestructions_.load(std::memory_order_relaxed),
+                                                    load(copyConstructions_),
+                                                    load(copyAssignments_),
+                                                    load(moveConstructions_),
+                                                    load(moveAssignments_),
+                                                    load(objectsRetired_)};
+    publishSharedCounters(*slot, values);
+  }
+
+  static
   bool
   checkCounterOverflow() noexcept
   {
-    return ( (0 == objectsAlive_) ||
-             (objectsCreated_ != (objectsAlive_ + objectsDestroyed_)) );
+    return ( (0 == load(objectsAlive_)) ||
+             (load(objectsCreated_) != (load(objectsAlive_) + load(objectsDestroyed_))) );
   }
 };  // class objectCounter
 
-template <typename T, typename TC>
-std::mutex objectCounter<T, TC>::mtx_ {};
+template <typename T, typename TC, bool TT>
+std::mutex objectCounter<T, TC, TT>::mtx_ {};
+
+template <typename T, typename TC, bool TT>
+std::atomic<unsigned long> objectCounter<T, TC, TT>::seq_ {0};
+
+template <typename T, typename TC, bool TT>
+std::atomic<TC> objectCounter<T, TC, TT>::objectsCreated_ {0};
+
+template <typename T, typename TC, bool TT>
+std::atomic<TC> objectCounter<T, TC, TT>::objectsAlive_ {0};
+
+template <typename T, typename TC, bool TT>
+std::atomic<TC> objectCounter<T, TC, TT>::objectsDestroyed_ {0};
 
-template <typename T, typename TC>
-TC objectCounter<T, TC>::objectsCreated_ {0};
+template <typename T, typename TC, bool TT>
+std::atomic<TC> objectCounter<T, TC, TT>::objectsRetired_ {0};
 
-template <typename T, typename TC>
-TC objectCounter<T, TC>::objectsAlive_ {0};
+template <typename T, typename TC, bool TT>
+std::atomic<TC> objectCounter<T, TC, TT>::copyConstructions_ {0};
 
-template <typename T, typename TC>
-TC objectCounter<T, TC>::objectsDestroyed_ {0};
+template <typename T, typename TC, bool TT>
+std::atomic<TC> objectCounter<T, TC, TT>::copyAssignments_ {0};
 
-template <typename T, typename TC>
-TC objectCounter<T, TC>::copyConstructions_ {0};
+template <typename T, typename TC, bool TT>
+std::atomic<TC> objectCounter<T, TC, TT>::moveConstructions_ {0};
 
-template <typename T, typename TC>
-TC objectCounter<T, TC>::copyAssignments_ {0};
+template <typename T, typename TC, bool TT>
+std::atomic<TC> objectCounter<T, TC, TT>::moveAssignments_ {0};
 
-template <typename T, typename TC>
-TC objectCounter<T, TC>::moveConstructions_ {0};
+template <typename T, typename TC, bool TT>
+std::atomic<bool> objectCounter<T, TC, TT>::tooManyDestructions_ {false};
 
-template <typename T, typename TC>
-TC objectCounter<T, TC>::moveAssignments_ {0};
+template <typename T, typename TC, bool TT>
+std::atomic<sharedCounterSlot*> objectCounter<T, TC, TT>::sharedSlot_ {nullptr};
 
-template <typename T, typename TC>
-bool objectCounter<T, TC>::tooManyDestructions_ {false};
+template <typename T, typename TC, bool TT>
+threadMatrix<TC> objectCounter<T, TC, TT>::threadMatrix_ {};
 
 }  // namespace object_factory::object_counter
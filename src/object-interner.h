@@ -0,0 +1,211 @@
+//
+// object-interner.h
+//
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include "object-trace.h"
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory
+{
+//
+// Interning (flyweight) factory of immutable T's.
+//
+// Objects are looked up by the arguments they are constructed with: asking
+// twice for the same arguments returns a shared handle to the same instance
+// for as long as some handle to it is alive. The table holds only weak
+// entries, removed when the last handle to their instance goes away.
+//
+// The table is split in shards, each with its own lock, selected by the hash
+// of the arguments; Args must be hashable with std::hash and comparable with
+// ==. Objects are built under the lock of their shard, so two threads asking
+// for the same new arguments never build two instances.
+//
+// The interner can be destroyed before the handles it returned.
+//
+template <typename T, typename... Args>
+class objectInterner final
+{
+public:
+  using key = std::tuple<Args...>;
+  using handle = std::shared_ptr<const T>;
+  // lookups, hits, instances alive, bytes saved
+  using internCounters = std::tuple<unsigned long, unsigned long, unsigned long, std::size_t>;
+
+  objectInterner()
+  :
+  table_(std::make_shared<table>())
+  {}
+
+  objectInterner(const objectInterner& rhs) = delete;
+  objectInterner& operator=(const objectInterner& rhs) = delete;
+  objectInterner(objectInterner&& rhs) = delete;
+  objectInterner& operator=(objectInterner&& rhs) = delete;
+
+  handle intern(const Args&... args)
+  {
+    return intern(key {args...});
+  }
+
+  handle intern(const key& k)
+  {
+    table_->lookups_.fetch_add(1, std::memory_order_relaxed);
+    shard& s {table_->shardOf(k)};
+    std::lock_guard<std::mutex> lg(s.mtx_);
+    auto [it, inserted] = s.entries_.try_emplace(k);
+    if ( !inserted )
+    {
+      if ( handle object {it->second.lock()}; nullptr != object )
+      {
+        table_->hits_.fetch_add(1, std::memory_order_relaxed);
+        return object;
+      }
+    }
+    // a new entry, or one whose instance is being destroyed: the instance
+    // leaves alone the entry it finds alive again; instance and control block
+    // share a single allocation
+    try
+    {
+      auto i {std::make_shared<const instance>(table_, k)};
+      handle object {i, &i->value_};
+      it->second = object;
+      OBJECT_FACTORY_TRACE(factoryCreate, T, object.get());
+      return object;
+    }
+    catch (...)
+    {
+      if ( inserted )
+      {
+        s.entries_.erase(it);
+      }
+      throw;
+    }
+  }
+
+  // the bytes saved are sizeof(T) for every lookup served by an existing
+  // instance instead of a new allocation
+  auto getInternCounters() const noexcept -> internCounters
+  {
+    const unsigned long hits {table_->hits_.load(std::memory_order_relaxed)};
+    return std::make_tuple(table_->lookups_.load(std::memory_order_relaxed),
+                           hits,
+                           table_->alive_.load(std::memory_order_relaxed),
+                           hits * sizeof(T));
+  }
+
+  // lookups per instance built, 1.0 when nothing was deduplicated
+  double getDedupRatio() const noexcept
+  {
+    const auto [lookups, hits, alive, bytesSaved] = getInternCounters();
+    const unsigned long built {lookups - hits};
+    return (0 == built) ? 1.0 : static_cast<double>(lookups) / static_cast<double>(built);
+  }
+
+  // the number of entries in the table
+  std::size_t size() const
+  {
+    std::size_t n {0};
+    for (auto&& s : table_->shards_)
+    {
+      std::lock_guard<std::mutex> lg(s.mtx_);
+      n += s.entries_.size();
+    }
+    return n;
+  }
+
+private:
+  struct keyHash
+  {
+    std::size_t operator()(const key& k) const noexcept
+    {
+      return std::apply([] (const Args&... a)
+                        {
+                          std::size_t h {0};
+                          // boost::hash_combine
+                          ((h ^= std::hash<Args>{}(a) + 0x9e3779b9 + (h << 6) + (h >> 2)), ...);
+                          return h;
+                        },
+                        k);
+    }
+  };
+
+  // aligned to a cache line to avoid false sharing between shards
+  struct alignas(64) shard
+  {
+    mutable std::mutex mtx_ {};
+    std::unordered_map<key, std::weak_ptr<const T>, keyHash> entries_ {};
+  };
+
+  static constexpr std::size_t shardCount {16};
+
+  // shared with the instances, so it outlives the interner if handles do
+  struct table
+  {
+    shard& shardOf(const key& k) noexcept
+    {
+      return shards_[keyHash{}(k) % shardCount];
+    }
+
+    shard shards_[shardCount] {};
+    std::atomic<unsigned long> lookups_ {0};
+    std::atomic<unsigned long> hits_ {0};
+    std::atomic<unsigned long> alive_ {0};
+  };
+
+  // an interned T, removing its entry from the table when destroyed
+  struct instance final
+  {
+    instance(std::shared_ptr<table> t, const key& k)
+    :
+    value_(std::make_from_tuple<T>(k)),
+    table_(std::move(t)),
+    key_(k)
+    {
+      table_->alive_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ~instance() noexcept
+    {
+      table_->alive_.fetch_sub(1, std::memory_order_relaxed);
+      shard& s {table_->shardOf(key_)};
+      std::lock_guard<std::mutex> lg(s.mtx_);
+      // the entry may point to a newer instance built in the meantime
+      if ( auto it {s.entries_.find(key_)}; (s.entries_.end() != it) && it->second.expired() )
+      {
+        s.entries_.erase(it);
+      }
+    }
+
+    instance(const instance& rhs) = delete;
+    instance& operator=(const instance& rhs) = delete;
+
+    const T value_;
+    const std::shared_ptr<table> table_;
+    const key key_;
+  };  // struct instance
+
+  const std::shared_ptr<table> table_;
+};  // class objectInterner
+
+template <typename T>
+using internedObjectFactoryFun = std::function<std::shared_ptr<const T>(void)>;
+
+template <typename T, typename... Args, typename... KeyArgs>
+auto
+createInternedObjectFactoryFun(objectInterner<T, Args...>& interner, KeyArgs&&... args) -> internedObjectFactoryFun<T>
+{
+  // all the objects returned by the function object are the same instance
+  // while one of them is alive; the interner must outlive the function object
+  return [&interner, k = typename objectInterner<T, Args...>::key {std::forward<KeyArgs>(args)...}]()
+         {
+           return interner.intern(k);
+         };
+}
+}  // namespace object_factory
@@ -0,0 +1,236 @@
+//
+// object-pool.cpp
+//
+#include "object-pool.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdint>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory
+{
+namespace
+{
+// parse a sysfs cpu list like "0-3,8-11" into the cpus it contains
+std::vector<std::size_t>
+parseCpuList(const std::string& cpuList)
+{
+  std::vector<std::size_t> cpus {};
+  std::istringstream iss(cpuList);
+  std::string range {};
+  while ( std::getline(iss, range, ',') )
+  {
+    if ( range.empty() || ('\n' == range[0]) )
+    {
+      continue;
+    }
+    const std::size_t dash {range.find('-')};
+    const std::size_t first {std::stoul(range.substr(0, dash))};
+    const std::size_t last {(std::string::npos == dash) ? first : std::stoul(range.substr(dash + 1))};
+    for (std::size_t cpu {first}; cpu <= last; ++cpu)
+    {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+// the NUMA node of each cpu, read once from sysfs
+const std::vector<std::size_t>&
+cpuToNode() noexcept
+{
+  static const std::vector<std::size_t> cpuNodes = [] () noexcept
+  {
+    std::vector<std::size_t> nodes {};
+    try
+    {
+      for (std::size_t node {0}; ; ++node)
+      {
+        std::ifstream ifs("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if ( !ifs )
+        {
+          break;
+        }
+        std::string cpuList {};
+        std::getline(ifs, cpuList);
+        for (auto&& cpu : parseCpuList(cpuList))
+        {
+          if ( cpu >= nodes.size() )
+          {
+            nodes.resize(cpu + 1, 0);
+          }
+          nodes[cpu] = node;
+        }
+      }
+    }
+    catch (...)
+    {
+      // unknown topology: everything is on node 0
+      nodes.clear();
+    }
+    return nodes;
+  }();
+  return cpuNodes;
+}
+
+thread_local std::size_t simulatedNode {0};
+
+// the selected mode is the bracketed one, as in "always [madvise] never";
+// no file means a kernel without transparent huge pages
+bool
+readTransparentHugePagesEnabled() noexcept
+{
+  try
+  {
+    std::ifstream ifs("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string modes {};
+    std::getline(ifs, modes);
+    return (std::string::npos != modes.find("[always]")) || (std::string::npos != modes.find("[madvise]"));
+  }
+  catch (...)
+  {
+    return false;
+  }
+}
+
+std::size_t
+pageSize() noexcept
+{
+  static const std::size_t size {static_cast<std::size_t>(::sysconf(_SC_PAGESIZE))};
+  return size;
+}
+
+// a fresh anonymous mapping of size bytes, a multiple of the page size,
+// aligned to alignment, a power of two; nullptr if it can't be mapped.
+// Unlike recycled heap memory its pages have never been touched, so each is
+// placed on the node of the thread writing it first
+void*
+mapAligned(const std::size_t size, const std::size_t alignment) noexcept
+{
+  // map an alignment more to trim the mapping to an aligned boundary
+  const std::size_t extra {(alignment > pageSize()) ? alignment : 0};
+  void* mapping {::mmap(nullptr, size + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)};
+  if ( MAP_FAILED == mapping )
+  {
+    return nullptr;
+  }
+  if ( 0 == extra )
+  {
+    return mapping;
+  }
+  const std::uintptr_t begin {reinterpret_cast<std::uintptr_t>(mapping)};
+  const std::uintptr_t aligned {(begin + alignment - 1) & ~(alignment - 1)};
+  const std::size_t head {aligned - begin};
+  if ( 0 != head )
+  {
+    ::munmap(mapping, head);
+  }
+  if ( extra != head )
+  {
+    ::munmap(reinterpret_cast<void*>(aligned + size), extra - head);
+  }
+  return reinterpret_cast<void*>(aligned);
+}
+}  // namespace
+
+poolChunk
+allocatePoolChunk(std::size_t size, std::size_t alignment, chunkBacking backing)
+{
+  if ( (chunkBacking::hugePages == backing) && (alignment <= hugePageSize) )
+  {
+    const std::size_t hugeSize {(size + hugePageSize - 1) / hugePageSize * hugePageSize};
+#if defined(MAP_HUGETLB)
+    int hugeTLBFlags {MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB};
+#if defined(MAP_HUGE_2MB)
+    // don't depend on the default huge page size of the host
+    hugeTLBFlags |= MAP_HUGE_2MB;
+#endif
+    // fails unless huge pages are reserved in /proc/sys/vm/nr_hugepages
+    void* address {::mmap(nullptr, hugeSize, PROT_READ | PROT_WRITE, hugeTLBFlags, -1, 0)};
+    if ( MAP_FAILED != address )
+    {
+      return {address, hugeSize, chunkKind::hugeTLB};
+    }
+#endif
+#if defined(MADV_HUGEPAGE)
+    // the kernel only backs aligned 2 MiB ranges with transparent huge pages;
+    // with them disabled madvise() succeeds without effect, so don't map any
+    if ( void* address {transparentHugePagesEnabled() ? mapAligned(hugeSize, hugePageSize) : nullptr};
+         nullptr != address )
+    {
+      if ( 0 == ::madvise(address, hugeSize, MADV_HUGEPAGE) )
+      {
+        return {address, hugeSize, chunkKind::transparentHugePages};
+      }
+      ::munmap(address, hugeSize);
+    }
+#endif
+  }
+  const std::size_t page {pageSize()};
+  const std::size_t regularSize {(size + page - 1) / page * page};
+  void* address {mapAligned(regularSize, alignment)};
+  if ( nullptr == address )
+  {
+    throw std::bad_alloc();
+  }
+  return {address, regularSize, chunkKind::regular};
+}
+
+bool
+transparentHugePagesEnabled() noexcept
+{
+  static const bool enabled {readTransparentHugePagesEnabled()};
+  return enabled;
+}
+
+void
+freePoolChunk(const poolChunk& chunk) noexcept
+{
+  ::munmap(chunk.address_, chunk.size_);
+}
+
+std::size_t
+numaNodeCount() noexcept
+{
+  std::size_t nodes {0};
+  for (auto&& node : cpuToNode())
+  {
+    nodes = std::max(nodes, node + 1);
+  }
+  return (0 == nodes) ? 1 : nodes;
+}
+
+std::size_t
+currentNumaNode() noexcept
+{
+  const int cpu {::sched_getcpu()};
+  const auto& nodes {cpuToNode()};
+  if ( (cpu < 0) || (static_cast<std::size_t>(cpu) >= nodes.size()) )
+  {
+    return 0;
+  }
+  return nodes[static_cast<std::size_t>(cpu)];
+}
+
+std::size_t
+simulatedNumaNode() noexcept
+{
+  return simulatedNode;
+}
+
+simulatedNumaNodeScope::simulatedNumaNodeScope(std::size_t node) noexcept
+:
+previousNode_(simulatedNode)
+{
+  simulatedNode = node;
+}
+
+simulatedNumaNodeScope::~simulatedNumaNodeScope() noexcept
+{
+  simulatedNode = previousNode_;
+}
+}  // namespace object_factory
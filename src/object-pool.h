@@ -0,0 +1,348 @@
+//
+// object-pool.h
+//
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include <vector>
+#include "object-trace.h"
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory
+{
+// the number of NUMA nodes of the host, 1 if it can't be determined
+std::size_t numaNodeCount() noexcept;
+
+// the NUMA node of the CPU the calling thread is running on, 0 if unknown
+std::size_t currentNumaNode() noexcept;
+
+// the node set for the calling thread by a simulatedNumaNodeScope, 0 otherwise;
+// used as node selector it simulates several nodes on a single node host
+std::size_t simulatedNumaNode() noexcept;
+
+// how the chunks of a pool are backed
+enum class chunkBacking
+{
+  // pages of the base size of the host
+  regular,
+  // 2 MiB pages: explicit huge pages (MAP_HUGETLB) if some are reserved,
+  // otherwise transparent huge pages (madvise(MADV_HUGEPAGE)), otherwise
+  // regular memory
+  hugePages
+};
+
+// how a chunk was actually backed
+enum class chunkKind
+{
+  hugeTLB,
+  transparentHugePages,
+  regular
+};
+
+constexpr std::size_t hugePageSize {2 * 1'024 * 1'024};
+
+// whether the host may back madvise(MADV_HUGEPAGE) ranges with transparent
+// huge pages: the mode in /sys/kernel/mm/transparent_hugepage/enabled, read
+// once, is always or madvise; madvise() itself succeeds even when it is never
+bool transparentHugePagesEnabled() noexcept;
+
+struct poolChunk
+{
+  void* address_;
+  std::size_t size_;
+  chunkKind kind_;
+};
+
+// map a chunk of at least size bytes aligned to alignment, a power of two,
+// rounded up to a multiple of the page size, or of hugePageSize for huge page
+// chunks; the chunk is a fresh anonymous mapping, never recycled heap memory;
+// throw std::bad_alloc if even regular memory can't be mapped
+poolChunk allocatePoolChunk(std::size_t size, std::size_t alignment, chunkBacking backing);
+
+void freePoolChunk(const poolChunk& chunk) noexcept;
+
+// RAII scope setting the simulated NUMA node of the calling thread
+class simulatedNumaNodeScope final
+{
+public:
+  explicit
+  simulatedNumaNodeScope(std::size_t node) noexcept;
+  ~simulatedNumaNodeScope() noexcept;
+
+  simulatedNumaNodeScope(const simulatedNumaNodeScope& rhs) = delete;
+  simulatedNumaNodeScope& operator=(const simulatedNumaNodeScope& rhs) = delete;
+  simulatedNumaNodeScope(simulatedNumaNodeScope&& rhs) = delete;
+  simulatedNumaNodeScope& operator=(simulatedNumaNodeScope&& rhs) = delete;
+
+private:
+  const std::size_t previousNode_;
+};  // class simulatedNumaNodeScope
+
+//
+// A pool of T's with an arena per NUMA node.
+//
+// Objects are allocated from the arena of the caller's node. Each arena
+// carves its slots out of chunks freshly mapped and first touched by a thread
+// of that node, so with the default first-touch policy of Linux its memory is
+// local. A regular chunk holds slotsPerChunk slots.
+//
+// An object freed on its own node goes back to the arena free list; an object
+// freed on another node is pushed, lock-free, onto the return queue of the
+// owning arena, which takes back the whole queue in one batch when its free
+// list runs out. Memory never migrates between arenas.
+//
+// With chunkBacking::hugePages the chunks are backed by 2 MiB pages when the
+// host allows it, which cuts the TLB misses of code walking many pooled
+// objects; a huge page chunk holds all the slots that fit in it, possibly
+// more than slotsPerChunk. Transparent huge pages are only advised: the
+// kernel may still back part of such chunks with regular pages.
+//
+// The pool must outlive all the objects it creates.
+//
+template <typename T>
+class objectPool final
+{
+public:
+  using nodeSelectorFun = std::size_t (*)() noexcept;
+  // allocations, local frees, remote frees, chunks
+  using poolCounters = std::tuple<unsigned long, unsigned long, unsigned long, std::size_t>;
+  // explicit huge page, transparent huge page and regular chunks
+  using chunkCounters = std::tuple<std::size_t, std::size_t, std::size_t>;
+
+  explicit
+  objectPool(std::size_t nodes = numaNodeCount(),
+             nodeSelectorFun nodeSelector = &currentNumaNode,
+             std::size_t slotsPerChunk = 1'024,
+             chunkBacking backing = chunkBacking::regular)
+  :
+  nodeSelector_(nodeSelector),
+  slotsPerChunk_((0 == slotsPerChunk) ? 1 : slotsPerChunk),
+  backing_(backing),
+  arenas_((0 == nodes) ? 1 : nodes)
+  {}
+
+  ~objectPool() noexcept
+  {
+    for (auto&& a : arenas_)
+    {
+      for (auto&& chunk : a.chunks_)
+      {
+        freePoolChunk(chunk);
+      }
+    }
+  }
+
+  objectPool(const objectPool& rhs) = delete;
+  objectPool& operator=(const objectPool& rhs) = delete;
+  objectPool(objectPool&& rhs) = delete;
+  objectPool& operator=(objectPool&& rhs) = delete;
+
+  std::size_t nodes() const noexcept
+  {
+    return arenas_.size();
+  }
+
+  template <typename... Args>
+  T* construct(Args&&... args)
+  {
+    slot* s {allocate(callerNode())};
+    try
+    {
+      return ::new (static_cast<void*>(s->storage_)) T(std::forward<Args>(args)...);
+    }
+    catch (...)
+    {
+      release(s);
+      throw;
+    }
+  }
+
+  void destroy(T* object) noexcept
+  {
+    if ( nullptr == object )
+    {
+      return;
+    }
+    object->~T();
+    release(reinterpret_cast<slot*>(reinterpret_cast<unsigned char*>(object)));
+  }
+
+  auto getNodeCounters(std::size_t node) const noexcept -> poolCounters
+  {
+    const arena& a {arenas_.at(node)};
+    return std::make_tuple(a.allocations_.load(std::memory_order_relaxed),
+                           a.localFrees_.load(std::memory_order_relaxed),
+                           a.remoteFrees_.load(std::memory_order_relaxed),
+                           a.chunkCount_.load(std::memory_order_relaxed));
+  }
+
+  auto getPoolCounters() const noexcept -> poolCounters
+  {
+    poolCounters total {0, 0, 0, 0};
+    for (std::size_t node {0}; node < arenas_.size(); ++node)
+    {
+      const auto [allocations, localFrees, remoteFrees, chunks] = getNodeCounters(node);
+      std::get<0>(total) += allocations;
+      std::get<1>(total) += localFrees;
+      std::get<2>(total) += remoteFrees;
+      std::get<3>(total) += chunks;
+    }
+    return total;
+  }
+
+  auto getChunkCounters() const noexcept -> chunkCounters
+  {
+    return std::make_tuple(chunkKinds_[static_cast<std::size_t>(chunkKind::hugeTLB)].load(std::memory_order_relaxed),
+                           chunkKinds_[static_cast<std::size_t>(chunkKind::transparentHugePages)].load(std::memory_order_relaxed),
+                           chunkKinds_[static_cast<std::size_t>(chunkKind::regular)].load(std::memory_order_relaxed));
+  }
+
+private:
+  struct slot
+  {
+    // must be the first member: objects and slots share the address
+    alignas(T) unsigned char storage_[sizeof(T)];
+    slot* next_;
+    std::size_t node_;
+  };
+
+  // aligned to a cache line to avoid false sharing between nodes
+  struct alignas(64) arena
+  {
+    std::mutex mtx_ {};
+    slot* freeList_ {nullptr};
+    std::vector<poolChunk> chunks_ {};
+    std::atomic<slot*> returnQueue_ {nullptr};
+    std::atomic<unsigned long> allocations_ {0};
+    std::atomic<unsigned long> localFrees_ {0};
+    std::atomic<unsigned long> remoteFrees_ {0};
+    std::atomic<std::size_t> chunkCount_ {0};
+  };
+
+  std::size_t callerNode() const noexcept
+  {
+    return nodeSelector_() % arenas_.size();
+  }
+
+  slot* allocate(const std::size_t node)
+  {
+    arena& a {arenas_[node]};
+    std::lock_guard<std::mutex> lg(a.mtx_);
+    if ( nullptr == a.freeList_ )
+    {
+      // take back all the slots freed by other nodes in one go
+      a.freeList_ = a.returnQueue_.exchange(nullptr, std::memory_order_acquire);
+    }
+    if ( nullptr == a.freeList_ )
+    {
+      addChunk(a, node);
+    }
+    slot* s {a.freeList_};
+    a.freeList_ = s->next_;
+    a.allocations_.fetch_add(1, std::memory_order_relaxed);
+    return s;
+  }
+
+  void release(slot* s) noexcept
+  {
+    arena& a {arenas_[s->node_]};
+    if ( s->node_ == callerNode() )
+    {
+      std::lock_guard<std::mutex> lg(a.mtx_);
+      s->next_ = a.freeList_;
+      a.freeList_ = s;
+      a.localFrees_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    // remote free: the queue is only ever emptied as a whole, so a plain
+    // compare-and-swap push is free from ABA problems
+    s->next_ = a.returnQueue_.load(std::memory_order_relaxed);
+    while ( !a.returnQueue_.compare_exchange_weak(s->next_, s,
+                                                  std::memory_order_release,
+                                                  std::memory_order_relaxed) )
+    {}
+    a.remoteFrees_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // called with a.mtx_ locked by a thread of the given node
+  void addChunk(arena& a, const std::size_t node)
+  {
+    a.chunks_.reserve(a.chunks_.size() + 1);
+    const poolChunk chunk {allocatePoolChunk(sizeof(slot) * slotsPerChunk_, alignof(slot), backing_)};
+    a.chunks_.push_back(chunk);
+    a.chunkCount_.fetch_add(1, std::memory_order_relaxed);
+    chunkKinds_[static_cast<std::size_t>(chunk.kind_)].fetch_add(1, std::memory_order_relaxed);
+
+    // threading the free list touches every slot from this node
+    slot* slots {static_cast<slot*>(chunk.address_)};
+    const std::size_t slotCount {(chunkKind::regular == chunk.kind_) ? slotsPerChunk_ : chunk.size_ / sizeof(slot)};
+    for (std::size_t i {slotCount}; i > 0; --i)
+    {
+      slot* s {::new (static_cast<void*>(&slots[i - 1])) slot};
+      s->node_ = node;
+      s->next_ = a.freeList_;
+      a.freeList_ = s;
+    }
+  }
+
+  const nodeSelectorFun nodeSelector_;
+  const std::size_t slotsPerChunk_;
+  const chunkBacking backing_;
+  std::vector<arena> arenas_;
+  std::atomic<std::size_t> chunkKinds_[3] {};
+};  // class objectPool
+
+// deleter returning objects to the pool they come from
+template <typename T>
+class poolDeleter final
+{
+public:
+  poolDeleter() noexcept = default;
+
+  explicit
+  poolDeleter(objectPool<T>& pool) noexcept
+  :
+  pool_(&pool)
+  {}
+
+  void operator()(T* object) const noexcept
+  {
+    pool_->destroy(object);
+  }
+
+private:
+  objectPool<T>* pool_ {nullptr};
+};  // class poolDeleter
+
+template <typename T>
+using pooledUniquePtr = std::unique_ptr<T, poolDeleter<T>>;
+
+template <typename T>
+using pooledObjectFactoryFun = std::function<pooledUniquePtr<T>(void)>;
+
+// create an object of type T in pool
+template <typename T, typename... Args>
+auto
+createPooledUniquePtr(objectPool<T>& pool, Args&&... args) -> pooledUniquePtr<T>
+{
+  pooledUniquePtr<T> object {pool.construct(args...), poolDeleter<T>(pool)};
+  OBJECT_FACTORY_TRACE(factoryCreate, T, object.get());
+  return object;
+}
+
+template <typename T, typename... Args>
+auto
+createPooledObjectFactoryFun(objectPool<T>& pool, Args&&... args) noexcept -> pooledObjectFactoryFun<T>
+{
+  // the pool must outlive the function object and all the objects it creates
+  return [&pool, args...]()
+         {
+           return createPooledUniquePtr<T>(pool, args...);
+         };
+}
+}  // namespace object_factory
@@ -0,0 +1,363 @@
+//
+// object-trace.cpp
+//
+#include "object-trace.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unistd.h>
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory::object_trace
+{
+namespace
+{
+std::atomic<traceHookFun> traceHook {nullptr};
+std::atomic<std::uint32_t> nextThreadId {0};
+
+std::uint32_t
+currentThreadId() noexcept
+{
+  thread_local const std::uint32_t threadId {nextThreadId.fetch_add(1, std::memory_order_relaxed)};
+  return threadId;
+}
+
+struct threadRing
+{
+  explicit
+  threadRing(const std::size_t capacity)
+  :
+  events_(new traceEvent[capacity]),
+  capacity_(capacity)
+  {}
+
+  const std::unique_ptr<traceEvent[]> events_;
+  const std::size_t capacity_;
+  // only ever written by the owner thread
+  std::atomic<std::uint64_t> written_ {0};
+  // guarded by ringsMtx
+  bool inUse_ {false};
+};
+
+std::atomic<std::size_t> ringCapacity {ringBufferSink::defaultCapacity_};
+
+// all the rings allocated, and those not owned by any thread; freeRings has
+// room for all of them, so that giving a ring back never allocates
+std::mutex ringsMtx {};
+std::vector<std::unique_ptr<threadRing>> rings {};
+std::vector<threadRing*> freeRings {};
+
+// called with ringsMtx locked
+void
+addFreeRing(std::unique_ptr<threadRing> ring)
+{
+  rings.reserve(rings.size() + 1);
+  freeRings.reserve(rings.size() + 1);
+  freeRings.push_back(ring.get());
+  rings.push_back(std::move(ring));
+}
+
+// owns the ring of a thread, giving it back to the free list when the thread
+// exits
+class ringOwner final
+{
+public:
+  ringOwner()
+  :
+  ring_(acquire())
+  {}
+
+  ~ringOwner() noexcept
+  {
+    std::lock_guard<std::mutex> lg(ringsMtx);
+    ring_->inUse_ = false;
+    freeRings.push_back(ring_);
+  }
+
+  ringOwner(const ringOwner& rhs) = delete;
+  ringOwner& operator=(const ringOwner& rhs) = delete;
+  ringOwner(ringOwner&& rhs) = delete;
+  ringOwner& operator=(ringOwner&& rhs) = delete;
+
+  threadRing& ring() const noexcept
+  {
+    return *ring_;
+  }
+
+private:
+  static
+  threadRing*
+  acquire()
+  {
+    {
+      std::lock_guard<std::mutex> lg(ringsMtx);
+      if ( !freeRings.empty() )
+      {
+        threadRing* ring {freeRings.back()};
+        freeRings.pop_back();
+        // the events of the previous owner are dropped
+        ring->written_.store(0, std::memory_order_relaxed);
+        ring->inUse_ = true;
+        return ring;
+      }
+    }
+    // allocated without holding the lock
+    auto ring {std::make_unique<threadRing>(ringCapacity.load(std::memory_order_relaxed))};
+    ring->inUse_ = true;
+    threadRing* r {ring.get()};
+    std::lock_guard<std::mutex> lg(ringsMtx);
+    addFreeRing(std::move(ring));
+    freeRings.pop_back();
+    return r;
+  }
+
+  threadRing* const ring_;
+};  // class ringOwner
+
+threadRing&
+currentThreadRing()
+{
+  thread_local const ringOwner owner {};
+  return owner.ring();
+}
+
+std::ofstream
+openDumpFile(const std::string& fileName)
+{
+  std::ofstream ofs(fileName, std::ios::binary | std::ios::trunc);
+  if ( !ofs )
+  {
+    throw std::runtime_error("Cannot open trace file " + fileName);
+  }
+  return ofs;
+}
+
+template <typename V>
+void
+writeValue(std::ofstream& ofs, const V value)
+{
+  ofs.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void
+writeJsonString(std::ofstream& ofs, const char* s)
+{
+  ofs << '"';
+  for (; '\0' != *s; ++s)
+  {
+    if ( ('"' == *s) || ('\\' == *s) )
+    {
+      ofs << '\\';
+    }
+    ofs << *s;
+  }
+  ofs << '"';
+}
+}  // namespace
+
+const char*
+traceEventKindName(traceEventKind kind) noexcept
+{
+  switch (kind)
+  {
+    case traceEventKind::factoryCreate:
+      return "factoryCreate";
+    case traceEventKind::construction:
+      return "construction";
+    case traceEventKind::copyConstruction:
+      return "copyConstruction";
+    case traceEventKind::moveConstruction:
+      return "moveConstruction";
+    case traceEventKind::copyAssignment:
+      return "copyAssignment";
+    case traceEventKind::moveAssignment:
+      return "moveAssignment";
+    case traceEventKind::destruction:
+      return "destruction";
+  }
+  return "unknown";
+}
+
+void
+setTraceHook(traceHookFun hook) noexcept
+{
+  traceHook.store(hook, std::memory_order_release);
+}
+
+traceHookFun
+getTraceHook() noexcept
+{
+  return traceHook.load(std::memory_order_acquire);
+}
+
+void
+emitTraceEvent(traceEventKind kind, const char* typeName, const void* object) noexcept
+{
+  const traceHookFun hook {getTraceHook()};
+  if ( nullptr == hook )
+  {
+    return;
+  }
+  const auto now {std::chrono::steady_clock::now().time_since_epoch()};
+  hook({static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()),
+        typeName,
+        object,
+        currentThreadId(),
+        kind});
+}
+
+void
+ringBufferSink::record(const traceEvent& event) noexcept
+{
+  try
+  {
+    threadRing& ring {currentThreadRing()};
+    const std::uint64_t n {ring.written_.load(std::memory_order_relaxed)};
+    ring.events_[n % ring.capacity_] = event;
+    ring.written_.store(n + 1, std::memory_order_release);
+  }
+  catch (...)
+  {
+    // the ring of this thread could not be allocated: the event is lost
+  }
+}
+
+std::vector<traceEvent>
+ringBufferSink::collect()
+{
+  std::vector<traceEvent> events {};
+  {
+    std::lock_guard<std::mutex> lg(ringsMtx);
+    for (auto&& ring : rings)
+    {
+      const std::uint64_t n {ring->written_.load(std::memory_order_acquire)};
+      const std::uint64_t first {(n > ring->capacity_) ? (n - ring->capacity_) : 0};
+      for (std::uint64_t i {first}; i < n; ++i)
+      {
+        events.push_back(ring->events_[i % ring->capacity_]);
+      }
+    }
+  }
+  std::stable_sort(events.begin(), events.end(),
+                   [] (const traceEvent& lhs, const traceEvent& rhs)
+                   {
+                     return lhs.timestampNs_ < rhs.timestampNs_;
+                   });
+  return events;
+}
+
+void
+ringBufferSink::clear() noexcept
+{
+  std::lock_guard<std::mutex> lg(ringsMtx);
+  freeRings.clear();
+  rings.erase(std::remove_if(rings.begin(), rings.end(),
+                             [] (const std::unique_ptr<threadRing>& ring)
+                             {
+                               return !ring->inUse_;
+                             }),
+              rings.end());
+  for (auto&& ring : rings)
+  {
+    ring->written_.store(0, std::memory_order_relaxed);
+  }
+}
+
+void
+ringBufferSink::setCapacity(std::size_t events) noexcept
+{
+  ringCapacity.store((0 == events) ? 1 : events, std::memory_order_relaxed);
+}
+
+std::size_t
+ringBufferSink::capacity() noexcept
+{
+  return ringCapacity.load(std::memory_order_relaxed);
+}
+
+void
+ringBufferSink::reserve(std::size_t count)
+{
+  for (;;)
+  {
+    {
+      std::lock_guard<std::mutex> lg(ringsMtx);
+      if ( freeRings.size() >= count )
+      {
+        return;
+      }
+    }
+    auto ring {std::make_unique<threadRing>(capacity())};
+    std::lock_guard<std::mutex> lg(ringsMtx);
+    addFreeRing(std::move(ring));
+  }
+}
+
+std::size_t
+ringBufferSink::ringCount() noexcept
+{
+  std::lock_guard<std::mutex> lg(ringsMtx);
+  return rings.size();
+}
+
+std::size_t
+ringBufferSink::dumpBinary(const std::string& fileName)
+{
+  const std::vector<traceEvent> events {collect()};
+  std::ofstream ofs {openDumpFile(fileName)};
+
+  ofs.write("OFTRACE1", 8);
+  writeValue(ofs, static_cast<std::uint64_t>(events.size()));
+  for (auto&& e : events)
+  {
+    const std::string typeName {e.typeName_};
+    writeValue(ofs, e.timestampNs_);
+    writeValue(ofs, static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(e.object_)));
+    writeValue(ofs, e.threadId_);
+    writeValue(ofs, static_cast<std::uint8_t>(e.kind_));
+    writeValue(ofs, static_cast<std::uint16_t>(typeName.size()));
+    ofs.write(typeName.data(), static_cast<std::streamsize>(typeName.size()));
+  }
+  if ( !ofs )
+  {
+    throw std::runtime_error("Cannot write trace file " + fileName);
+  }
+  return events.size();
+}
+
+std::size_t
+ringBufferSink::dumpChromeTrace(const std::string& fileName)
+{
+  const std::vector<traceEvent> events {collect()};
+  std::ofstream ofs {openDumpFile(fileName)};
+  const auto pid {::getpid()};
+
+  // instant events of the Chrome trace event format; timestamps in us
+  ofs << "{\"traceEvents\":[\n";
+  for (std::size_t i {0}; i < events.size(); ++i)
+  {
+    const traceEvent& e {events[i]};
+    ofs << "{\"name\":";
+    writeJsonString(ofs, traceEventKindName(e.kind_));
+    ofs << ",\"cat\":";
+    writeJsonString(ofs, e.typeName_);
+    ofs << ",\"ph\":\"i\",\"s\":\"t\""
+        << ",\"ts\":" << (e.timestampNs_ / 1'000) << '.'
+        << static_cast<char>('0' + (e.timestampNs_ / 100) % 10)
+        << ",\"pid\":" << pid
+        << ",\"tid\":" << e.threadId_
+        << ",\"args\":{\"object\":\"" << e.object_ << "\"}}"
+        << ((i + 1 < events.size()) ? ",\n" : "\n");
+  }
+  ofs << "]}\n";
+  if ( !ofs )
+  {
+    throw std::runtime_error("Cannot write trace file " + fileName);
+  }
+  return events.size();
+}
+}  // namespace object_factory::object_trace
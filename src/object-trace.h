@@ -0,0 +1,120 @@
+//
+// object-trace.h
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <typeinfo>
+#include <vector>
+////////////////////////////////////////////////////////////////////////////////
+//
+// Tracing hooks for factory and object counter events.
+//
+// The hooks in the factories and in objectCounter<T> are compiled in only when
+// OBJECT_FACTORY_TRACING is defined; otherwise OBJECT_FACTORY_TRACE expands to
+// nothing and tracing costs nothing at all.
+//
+// When compiled in, each event is passed to the hook set with setTraceHook();
+// with no hook set an event costs an atomic load.
+//
+#if defined(OBJECT_FACTORY_TRACING)
+#define OBJECT_FACTORY_TRACE(kind, type, object) \
+  ::object_factory::object_trace::emitTraceEvent(::object_factory::object_trace::traceEventKind::kind, \
+                                                 typeid(type).name(), \
+                                                 static_cast<const void*>(object))
+#else
+#define OBJECT_FACTORY_TRACE(kind, type, object) static_cast<void>(0)
+#endif
+
+namespace object_factory::object_trace
+{
+enum class traceEventKind : std::uint8_t
+{
+  factoryCreate,
+  construction,
+  copyConstruction,
+  moveConstruction,
+  copyAssignment,
+  moveAssignment,
+  destruction
+};
+
+const char* traceEventKindName(traceEventKind kind) noexcept;
+
+struct traceEvent
+{
+  std::uint64_t timestampNs_;
+  const char* typeName_;
+  const void* object_;
+  std::uint32_t threadId_;
+  traceEventKind kind_;
+};
+
+using traceHookFun = void (*)(const traceEvent& event) noexcept;
+
+// set the hook called for each event; nullptr disables it
+void setTraceHook(traceHookFun hook) noexcept;
+
+traceHookFun getTraceHook() noexcept;
+
+void emitTraceEvent(traceEventKind kind, const char* typeName, const void* object) noexcept;
+
+//
+// Built-in sink storing the events of each thread in a ring buffer of that
+// thread: recording is wait-free and never shared between threads, the oldest
+// events are overwritten when a buffer is full.
+//
+// Each ring takes capacity() * sizeof(traceEvent) bytes, 512 KiB with the
+// default 16384 events. A thread gets its ring with its first event, from a
+// free list if possible, otherwise allocating it; when the thread exits its
+// ring goes back to the free list. So the rings allocated are as many as the
+// threads ever tracing at the same time, not as the threads ever created;
+// reserve() allocates them up front, keeping the allocation out of the first
+// event of each thread.
+//
+// Events are collected and dumped from all the buffers, including those of
+// terminated threads whose ring has not been reused yet. Collect, dump and
+// clear when the traced threads are quiescent: an event overwritten while it
+// is read may come out torn.
+//
+// Binary dump layout, in native byte order:
+//   "OFTRACE1", uint64 event count, then for each event:
+//   uint64 timestamp ns, uint64 object address, uint32 thread id,
+//   uint8 event kind, uint16 type name length, type name bytes
+//
+class ringBufferSink final
+{
+public:
+  static constexpr std::size_t defaultCapacity_ {16'384};
+
+  ringBufferSink() = delete;
+
+  // usable as a trace hook: setTraceHook(&ringBufferSink::record)
+  static void record(const traceEvent& event) noexcept;
+
+  // the events recorded so far, sorted by timestamp
+  static std::vector<traceEvent> collect();
+
+  // drop all recorded events and free the rings not in use by a thread
+  static void clear() noexcept;
+
+  // the number of events of the rings allocated from now on; rings already
+  // allocated keep theirs until clear() frees them
+  static void setCapacity(std::size_t events) noexcept;
+  static std::size_t capacity() noexcept;
+
+  // allocate rings for the free list until it holds at least rings of them;
+  // throw std::bad_alloc
+  static void reserve(std::size_t rings);
+
+  // the number of rings allocated, in use or free
+  static std::size_t ringCount() noexcept;
+
+  // return the number of events written; throw std::runtime_error if the
+  // file can't be written
+  static std::size_t dumpBinary(const std::string& fileName);
+  static std::size_t dumpChromeTrace(const std::string& fileName);
+};  // class ringBufferSink
+}  // namespace object_factory::object_trace
@@ -6,7 +6,9 @@
  */
 #pragma once
 
+#include <functional>
 #include <memory>
+#include "object-trace.h"
 ////////////////////////////////////////////////////////////////////////////////
 namespace object_factory
 {
@@ -15,7 +17,9 @@ template <typename T, typename... Args>
 auto
 createUniquePtr(Args&&... args) -> std::unique_ptr<T>
 {
-  return std::make_unique<T>(args...);
+  std::unique_ptr<T> object {std::make_unique<T>(args...)};
+  OBJECT_FACTORY_TRACE(factoryCreate, T, object.get());
+  return object;
 }
 
 template <typename T>
@@ -32,4 +36,21 @@ createObjectFactoryFun(Args&&... args) noexcept -> objectFactoryFun<T>
            return createUniquePtr<T>(std::forward<Args>(args)...);
          };
 }
+
+template <typename T, typename... Args>
+auto
+createPrototypeFactoryFun(Args&&... args) -> objectFactoryFun<T>
+{
+  // build the prototype once with the given arguments, then return a function
+  // object creating copies of it: useful when constructing a T is expensive
+  // but copying it is cheap; if T is counted, the prototype is an object alive
+  // as long as the function object and its copies are
+  std::shared_ptr<const T> prototype = std::make_shared<const T>(std::forward<Args>(args)...);
+  return [prototype]()
+         {
+           std::unique_ptr<T> object {std::make_unique<T>(*prototype)};
+           OBJECT_FACTORY_TRACE(factoryCreate, T, object.get());
+           return object;
+         };
+}
 }  // namespace object_factory
@@ -0,0 +1,110 @@
+//
+// record-stream.cpp
+//
+#include "record-stream.h"
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory
+{
+namespace
+{
+constexpr std::size_t lengthPrefixSize {4};
+
+[[noreturn]]
+void
+throwSystemError(const std::string& what)
+{
+  throw std::system_error(errno, std::generic_category(), what);
+}
+}  // namespace
+
+mappedFile::mappedFile(const std::string& fileName)
+{
+  const int fd {::open(fileName.c_str(), O_RDONLY)};
+  if ( fd < 0 )
+  {
+    throwSystemError("open " + fileName);
+  }
+  struct stat st {};
+  if ( 0 != ::fstat(fd, &st) )
+  {
+    ::close(fd);
+    throwSystemError("fstat " + fileName);
+  }
+  size_ = static_cast<std::size_t>(st.st_size);
+  // an empty file can't be mapped and has no records anyway
+  if ( 0 != size_ )
+  {
+    void* address {::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0)};
+    if ( MAP_FAILED == address )
+    {
+      ::close(fd);
+      throwSystemError("mmap " + fileName);
+    }
+    // records are read once, front to back
+    ::madvise(address, size_, MADV_SEQUENTIAL);
+    address_ = static_cast<const char*>(address);
+  }
+  ::close(fd);
+}
+
+mappedFile::~mappedFile() noexcept
+{
+  if ( nullptr != address_ )
+  {
+    ::munmap(const_cast<char*>(address_), size_);
+  }
+}
+
+recordReader::recordReader(const mappedFile& file, recordFormat format, std::size_t recordSize)
+:
+data_(file.data()),
+format_(format),
+recordSize_(recordSize)
+{
+  if ( (recordFormat::fixedLength == format_) && (0 == recordSize_) )
+  {
+    throw std::invalid_argument("Fixed length records must have a non-zero size");
+  }
+}
+
+bool
+recordReader::next(std::string_view& record)
+{
+  if ( offset_ == data_.size() )
+  {
+    return false;
+  }
+
+  std::size_t recordSize {recordSize_};
+  std::size_t recordOffset {offset_};
+  if ( recordFormat::lengthPrefixed == format_ )
+  {
+    if ( data_.size() - offset_ < lengthPrefixSize )
+    {
+      throw std::runtime_error("Truncated record length at offset " + std::to_string(offset_));
+    }
+    const auto* prefix {reinterpret_cast<const unsigned char*>(data_.data() + offset_)};
+    recordSize = static_cast<std::size_t>(prefix[0]) |
+                 (static_cast<std::size_t>(prefix[1]) << 8) |
+                 (static_cast<std::size_t>(prefix[2]) << 16) |
+                 (static_cast<std::size_t>(prefix[3]) << 24);
+    recordOffset += lengthPrefixSize;
+  }
+  if ( data_.size() - recordOffset < recordSize )
+  {
+    throw std::runtime_error("Truncated record at offset " + std::to_string(offset_));
+  }
+
+  record = data_.substr(recordOffset, recordSize);
+  offset_ = recordOffset + recordSize;
+  ++recordsRead_;
+  return true;
+}
+}  // namespace object_factory
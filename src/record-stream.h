@@ -0,0 +1,149 @@
+//
+// record-stream.h
+//
+#pragma once
+
+#include "objectFactory.h"
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory
+{
+// read-only memory mapping of a whole file
+class mappedFile final
+{
+public:
+  // throw std::system_error if the file can't be opened or mapped
+  explicit
+  mappedFile(const std::string& fileName);
+  ~mappedFile() noexcept;
+
+  mappedFile(const mappedFile& rhs) = delete;
+  mappedFile& operator=(const mappedFile& rhs) = delete;
+  mappedFile(mappedFile&& rhs) = delete;
+  mappedFile& operator=(mappedFile&& rhs) = delete;
+
+  std::string_view data() const noexcept
+  {
+    return {address_, size_};
+  }
+
+private:
+  const char* address_ {nullptr};
+  std::size_t size_ {0};
+};  // class mappedFile
+
+enum class recordFormat
+{
+  // records of recordSize bytes each
+  fixedLength,
+  // records preceded by their length as a 4 byte little endian unsigned
+  lengthPrefixed
+};
+
+// splits the content of a mapped file into records without copying them
+class recordReader final
+{
+public:
+  recordReader(const mappedFile& file, recordFormat format, std::size_t recordSize = 0);
+
+  // set record to a view of the next record in the file and return true, or
+  // return false at the end of the file; throw std::runtime_error if the
+  // last record is truncated
+  bool next(std::string_view& record);
+
+  std::size_t recordsRead() const noexcept
+  {
+    return recordsRead_;
+  }
+
+private:
+  const std::string_view data_;
+  const recordFormat format_;
+  const std::size_t recordSize_;
+  std::size_t offset_ {0};
+  std::size_t recordsRead_ {0};
+};  // class recordReader
+
+//
+// Streaming factory constructing T's from the records of a file.
+//
+// The file is memory mapped and each T is constructed directly from a view of
+// its record, with no intermediate copy; by default with the constructor
+// T(std::string_view). The views are valid only during the construction:
+// T's must copy what they keep.
+//
+// Objects are produced lazily, one at a time with next(), or in batches.
+//
+template <typename T>
+class recordStreamFactory final
+{
+public:
+  using makeFun = std::function<std::unique_ptr<T>(std::string_view)>;
+
+  recordStreamFactory(const std::string& fileName,
+                      recordFormat format,
+                      std::size_t recordSize = 0,
+                      makeFun make = &createUniquePtr<T, std::string_view>)
+  :
+  file_(fileName),
+  reader_(file_, format, recordSize),
+  make_(std::move(make))
+  {}
+
+  // the object built from the next record, or nullptr at the end of the file
+  std::unique_ptr<T> next()
+  {
+    std::string_view record {};
+    if ( !reader_.next(record) )
+    {
+      return nullptr;
+    }
+    return make_(record);
+  }
+
+  // append to batch the objects built from up to maxRecords records and
+  // return how many were appended: 0 at the end of the file
+  std::size_t nextBatch(std::vector<std::unique_ptr<T>>& batch, const std::size_t maxRecords)
+  {
+    std::size_t n {0};
+    std::string_view record {};
+    for (; (n < maxRecords) && reader_.next(record); ++n)
+    {
+      batch.push_back(make_(record));
+    }
+    return n;
+  }
+
+  // pass all the remaining objects to consume, batchSize at a time, as a
+  // std::vector<std::unique_ptr<T>>&; return the number of objects built
+  template <typename Consumer>
+  std::size_t forEachBatch(const std::size_t batchSize, Consumer&& consume)
+  {
+    std::size_t n {0};
+    std::vector<std::unique_ptr<T>> batch {};
+    batch.reserve(batchSize);
+    while ( 0 != nextBatch(batch, batchSize) )
+    {
+      n += batch.size();
+      consume(batch);
+      batch.clear();
+    }
+    return n;
+  }
+
+  std::size_t recordsRead() const noexcept
+  {
+    return reader_.recordsRead();
+  }
+
+private:
+  const mappedFile file_;
+  recordReader reader_;
+  const makeFun make_;
+};  // class recordStreamFactory
+}  // namespace object_factory
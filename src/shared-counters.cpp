@@ -0,0 +1,280 @@
+//
+// shared-counters.cpp
+//
+#include "shared-counters.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory::object_counter
+{
+namespace
+{
+constexpr unsigned int maxReadAttempts {1'000'000};
+
+std::size_t
+segmentSize(const std::uint32_t capacity) noexcept
+{
+  return sizeof(sharedCounterHeader) + capacity * sizeof(sharedCounterSlot);
+}
+
+[[noreturn]]
+void
+throwSystemError(const std::string& what)
+{
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+// closes a file descriptor leaving a scope
+class fileDescriptor final
+{
+public:
+  explicit
+  fileDescriptor(int fd) noexcept
+  :
+  fd_(fd)
+  {}
+
+  ~fileDescriptor() noexcept
+  {
+    if ( fd_ >= 0 )
+    {
+      ::close(fd_);
+    }
+  }
+
+  fileDescriptor(const fileDescriptor& rhs) = delete;
+  fileDescriptor& operator=(const fileDescriptor& rhs) = delete;
+  fileDescriptor(fileDescriptor&& rhs) = delete;
+  fileDescriptor& operator=(fileDescriptor&& rhs) = delete;
+
+  int get() const noexcept
+  {
+    return fd_;
+  }
+
+private:
+  const int fd_;
+};  // class fileDescriptor
+
+// unmaps a memory mapping leaving a scope
+class memoryMapping final
+{
+public:
+  memoryMapping(void* address, std::size_t size) noexcept
+  :
+  address_(address),
+  size_(size)
+  {}
+
+  ~memoryMapping() noexcept
+  {
+    ::munmap(address_, size_);
+  }
+
+  memoryMapping(const memoryMapping& rhs) = delete;
+  memoryMapping& operator=(const memoryMapping& rhs) = delete;
+  memoryMapping(memoryMapping&& rhs) = delete;
+  memoryMapping& operator=(memoryMapping&& rhs) = delete;
+
+  const char* get() const noexcept
+  {
+    return static_cast<const char*>(address_);
+  }
+
+private:
+  void* const address_;
+  const std::size_t size_;
+};  // class memoryMapping
+
+// true if the segment name was left behind by a process that is gone; a
+// segment without a valid header may still be being initialized by its
+// creator, so it is never considered stale
+bool
+isStaleSegment(const std::string& name) noexcept
+{
+  const fileDescriptor fd {::shm_open(name.c_str(), O_RDONLY, 0)};
+  struct stat st {};
+  if ( (fd.get() < 0) ||
+       (0 != ::fstat(fd.get(), &st)) ||
+       (static_cast<std::size_t>(st.st_size) < sizeof(sharedCounterHeader)) )
+  {
+    return false;
+  }
+  void* address {::mmap(nullptr, sizeof(sharedCounterHeader), PROT_READ, MAP_SHARED, fd.get(), 0)};
+  if ( MAP_FAILED == address )
+  {
+    return false;
+  }
+  const memoryMapping mapping {address, sizeof(sharedCounterHeader)};
+  const auto* header {reinterpret_cast<const sharedCounterHeader*>(mapping.get())};
+  if ( (sharedCountersMagic != header->magic_) || (0 == header->pid_) )
+  {
+    return false;
+  }
+  return (0 != ::kill(static_cast<pid_t>(header->pid_), 0)) && (ESRCH == errno);
+}
+
+int
+createSegment(const std::string& name)
+{
+  int fd {::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644)};
+  if ( (fd < 0) && (EEXIST == errno) && isStaleSegment(name) )
+  {
+    ::shm_unlink(name.c_str());
+    fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  }
+  return fd;
+}
+}  // namespace
+
+sharedCounterSegment::sharedCounterSegment(const std::string& name, std::uint32_t capacity)
+:
+name_(name)
+{
+  const fileDescriptor fd {createSegment(name_)};
+  if ( fd.get() < 0 )
+  {
+    throwSystemError("shm_open " + name_);
+  }
+  size_ = segmentSize(capacity);
+  if ( 0 != ::ftruncate(fd.get(), static_cast<off_t>(size_)) )
+  {
+    ::shm_unlink(name_.c_str());
+    throwSystemError("ftruncate " + name_);
+  }
+  void* address {::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0)};
+  if ( MAP_FAILED == address )
+  {
+    ::shm_unlink(name_.c_str());
+    throwSystemError("mmap " + name_);
+  }
+
+  // the segment is zero filled; the magic number is written last
+  header_ = ::new (address) sharedCounterHeader {};
+  slots_ = reinterpret_cast<sharedCounterSlot*>(static_cast<char*>(address) + sizeof(sharedCounterHeader));
+  header_->version_ = sharedCountersLayoutVersion;
+  header_->capacity_ = capacity;
+  header_->pid_ = static_cast<std::uint32_t>(::getpid());
+  header_->slotsUsed_.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  header_->magic_ = sharedCountersMagic;
+}
+
+sharedCounterSegment::~sharedCounterSegment() noexcept
+{
+  std::vector<std::pair<sharedCounterSlot*, stopFun>> bindings {};
+  {
+    std::lock_guard<std::mutex> lg(mtx_);
+    bindings.swap(bindings_);
+  }
+  // called without holding mtx_: they take the locks of the counters
+  for (auto&& [slot, stop] : bindings)
+  {
+    stop(slot);
+  }
+  ::munmap(header_, size_);
+  ::shm_unlink(name_.c_str());
+}
+
+sharedCounterSlot*
+sharedCounterSegment::allocateSlot(const std::string& typeName, stopFun stop)
+{
+  std::lock_guard<std::mutex> lg(mtx_);
+
+  const std::uint32_t used {header_->slotsUsed_.load(std::memory_order_relaxed)};
+  if ( used >= header_->capacity_ )
+  {
+    throw std::length_error("Shared counter segment " + name_ + " is full");
+  }
+  if ( nullptr != stop )
+  {
+    // reserve first, so that no slot is published without its binding
+    bindings_.reserve(bindings_.size() + 1);
+  }
+  sharedCounterSlot* slot {::new (static_cast<void*>(&slots_[used])) sharedCounterSlot {}};
+  const std::size_t length {std::min(typeName.size(), sharedCounterTypeNameSize - 1)};
+  std::memcpy(slot->typeName_, typeName.data(), length);
+  slot->typeName_[length] = '\0';
+  header_->slotsUsed_.store(used + 1, std::memory_order_release);
+  if ( nullptr != stop )
+  {
+    bindings_.emplace_back(slot, stop);
+  }
+  return slot;
+}
+
+std::vector<sharedCounterSnapshot>
+readSharedCounters(const std::string& name)
+{
+  const fileDescriptor fd {::shm_open(name.c_str(), O_RDONLY, 0)};
+  if ( fd.get() < 0 )
+  {
+    throwSystemError("shm_open " + name);
+  }
+  struct stat st {};
+  if ( 0 != ::fstat(fd.get(), &st) )
+  {
+    throwSystemError("fstat " + name);
+  }
+  const std::size_t size {static_cast<std::size_t>(st.st_size)};
+  if ( size < sizeof(sharedCounterHeader) )
+  {
+    throw std::runtime_error("Shared counter segment " + name + " is too small");
+  }
+  void* address {::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd.get(), 0)};
+  if ( MAP_FAILED == address )
+  {
+    throwSystemError("mmap " + name);
+  }
+  const memoryMapping mapping {address, size};
+
+  const auto* header {reinterpret_cast<const sharedCounterHeader*>(mapping.get())};
+  const auto* slots {reinterpret_cast<const sharedCounterSlot*>(mapping.get() + sizeof(sharedCounterHeader))};
+  if ( (sharedCountersMagic != header->magic_) ||
+       (sharedCountersLayoutVersion != header->version_) ||
+       (segmentSize(header->capacity_) > size) )
+  {
+    throw std::runtime_error("Shared counter segment " + name + " has an unknown layout");
+  }
+
+  std::vector<sharedCounterSnapshot> snapshots {};
+  const std::uint32_t used {std::min(header->slotsUsed_.load(std::memory_order_acquire), header->capacity_)};
+  for (std::uint32_t i {0}; i < used; ++i)
+  {
+    const sharedCounterSlot& slot {slots[i]};
+    sharedCounterSnapshot snapshot {};
+    snapshot.typeName_.assign(slot.typeName_, ::strnlen(slot.typeName_, sharedCounterTypeNameSize));
+    // bounded retries: a process dying while writing leaves the slot locked
+    for (unsigned int attempt {1}; ; ++attempt)
+    {
+      const std::uint64_t before {slot.seq_.load(std::memory_order_acquire)};
+      const bool lastAttempt {attempt >= maxReadAttempts};
+      if ( (0 != (before & 1)) && !lastAttempt )
+      {
+        continue;
+      }
+      for (std::size_t k {0}; k < sharedCounterCount; ++k)
+      {
+        snapshot.values_[k] = slot.values_[k].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if ( lastAttempt || (before == slot.seq_.load(std::memory_order_relaxed)) )
+      {
+        break;
+      }
+    }
+    snapshots.push_back(std::move(snapshot));
+  }
+  return snapshots;
+}
+}  // namespace object_factory::object_counter
@@ -0,0 +1,140 @@
+//
+// shared-counters.h
+//
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory::object_counter
+{
+//
+// Layout of a POSIX shared memory segment exporting object counters to other
+// processes.
+//
+// The segment starts with a sharedCounterHeader followed by capacity_ slots.
+// A slot is published by writing its type name and then incrementing
+// slotsUsed_; the counters in a slot are written under the slot sequence
+// lock, so readers attached to the segment get consistent values without
+// ever blocking the process writing them.
+//
+// Any change to this layout must bump sharedCountersLayoutVersion.
+//
+constexpr std::uint64_t sharedCountersMagic {0x48534e544e43464fULL};  // "OFCNTNSH"
+constexpr std::uint32_t sharedCountersLayoutVersion {1};
+constexpr std::size_t sharedCounterTypeNameSize {128};
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+              "Shared counters need address-free lock-free 64 bit atomics");
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free,
+              "Shared counters need address-free lock-free 32 bit atomics");
+
+enum sharedCounterIndex : std::size_t
+{
+  objectsCreatedIndex,
+  objectsAliveIndex,
+  objectsDestroyedIndex,
+  tooManyDestructionsIndex,
+  copyConstructionsIndex,
+  copyAssignmentsIndex,
+  moveConstructionsIndex,
+  moveAssignmentsIndex,
+  objectsRetiredIndex,
+  sharedCounterCount
+};
+
+struct sharedCounterSlot
+{
+  // odd while the counters are being written
+  std::atomic<std::uint64_t> seq_;
+  char typeName_[sharedCounterTypeNameSize];
+  std::atomic<std::uint64_t> values_[sharedCounterCount];
+};
+
+struct sharedCounterHeader
+{
+  std::uint64_t magic_;
+  std::uint32_t version_;
+  std::uint32_t capacity_;
+  std::uint32_t pid_;
+  std::atomic<std::uint32_t> slotsUsed_;
+};
+
+// a consistent copy of the counters of a slot
+struct sharedCounterSnapshot
+{
+  std::string typeName_;
+  std::uint64_t values_[sharedCounterCount];
+};
+
+//
+// A named shared memory segment created by the process owning the counters,
+// which remove it when the segment is destroyed.
+//
+// The segment is created exclusively: a segment of the same name left behind
+// by a process that died without removing it is replaced, one owned by a live
+// process is not.
+//
+// Each slot can be bound to a stop function, called when the segment is
+// destroyed, so that objectCounter<T>'s exported to it stop writing there
+// even if they outlive it.
+//
+class sharedCounterSegment final
+{
+public:
+  using stopFun = void (*)(sharedCounterSlot* slot) noexcept;
+
+  // throw std::system_error if the segment can't be created, with
+  // std::errc::file_exists if a live process owns a segment of that name
+  explicit
+  sharedCounterSegment(const std::string& name, std::uint32_t capacity = 256);
+  ~sharedCounterSegment() noexcept;
+
+  sharedCounterSegment(const sharedCounterSegment& rhs) = delete;
+  sharedCounterSegment& operator=(const sharedCounterSegment& rhs) = delete;
+  sharedCounterSegment(sharedCounterSegment&& rhs) = delete;
+  sharedCounterSegment& operator=(sharedCounterSegment&& rhs) = delete;
+
+  const std::string& name() const noexcept
+  {
+    return name_;
+  }
+
+  // a new slot named typeName; stop, if any, is called with the slot when the
+  // segment is destroyed; throw std::length_error if the segment is full
+  sharedCounterSlot* allocateSlot(const std::string& typeName, stopFun stop = nullptr);
+
+private:
+  const std::string name_;
+  std::size_t size_ {0};
+  sharedCounterHeader* header_ {nullptr};
+  sharedCounterSlot* slots_ {nullptr};
+  std::mutex mtx_ {};
+  std::vector<std::pair<sharedCounterSlot*, stopFun>> bindings_ {};
+};  // class sharedCounterSegment
+
+// write the counters of a slot; the caller serializes the writers of a slot
+inline
+void
+publishSharedCounters(sharedCounterSlot& slot, const std::uint64_t (&values)[sharedCounterCount]) noexcept
+{
+  const std::uint64_t seq {slot.seq_.load(std::memory_order_relaxed)};
+  slot.seq_.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (std::size_t i {0}; i < sharedCounterCount; ++i)
+  {
+    slot.values_[i].store(values[i], std::memory_order_relaxed);
+  }
+  slot.seq_.store(seq + 2, std::memory_order_release);
+}
+
+// attach read-only to the segment name and read the counters of all its
+// slots; throw std::system_error if it can't be attached and
+// std::runtime_error if its layout is not the expected one
+std::vector<sharedCounterSnapshot> readSharedCounters(const std::string& name);
+}  // namespace object_factory::object_counter
@@ -0,0 +1,255 @@
+//
+// static-object-factory.h
+//
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "object-trace.h"
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory
+{
+template <typename T, std::size_t Capacity>
+class staticObjectFactory;
+
+// move-only handle to an object of a staticObjectFactory, giving its slot
+// back when destroyed; an empty handle owns nothing
+template <typename T, std::size_t Capacity>
+class staticHandle final
+{
+public:
+  staticHandle() noexcept = default;
+
+  staticHandle(staticHandle&& rhs) noexcept
+  :
+  factory_(std::exchange(rhs.factory_, nullptr)),
+  object_(std::exchange(rhs.object_, nullptr))
+  {}
+
+  staticHandle& operator=(staticHandle&& rhs) noexcept
+  {
+    if ( this != &rhs )
+    {
+      reset();
+      factory_ = std::exchange(rhs.factory_, nullptr);
+      object_ = std::exchange(rhs.object_, nullptr);
+    }
+    return *this;
+  }
+
+  staticHandle(const staticHandle& rhs) = delete;
+  staticHandle& operator=(const staticHandle& rhs) = delete;
+
+  ~staticHandle() noexcept
+  {
+    reset();
+  }
+
+  void reset() noexcept
+  {
+    if ( nullptr != object_ )
+    {
+      factory_->destroy(object_);
+      factory_ = nullptr;
+      object_ = nullptr;
+    }
+  }
+
+  T* get() const noexcept
+  {
+    return object_;
+  }
+
+  T* operator->() const noexcept
+  {
+    return object_;
+  }
+
+  T& operator*() const noexcept
+  {
+    return *object_;
+  }
+
+  explicit operator bool() const noexcept
+  {
+    return nullptr != object_;
+  }
+
+private:
+  friend class staticObjectFactory<T, Capacity>;
+
+  staticHandle(staticObjectFactory<T, Capacity>* factory, T* object) noexcept
+  :
+  factory_(factory),
+  object_(object)
+  {}
+
+  staticObjectFactory<T, Capacity>* factory_ {nullptr};
+  T* object_ {nullptr};
+};  // class staticHandle
+
+//
+// Factory constructing up to Capacity T's into storage of its own, for code
+// that must not allocate from the heap.
+//
+// Free slots are kept on a stack of indexes, so creating and destroying an
+// object are O(1); slots never used yet are handed out in order, so the
+// factory needs no initialization at run time and a static one is constant
+// initialized. A spinlock makes the factory thread safe without a mutex.
+//
+// When all the slots are in use create() returns an empty handle and counts
+// an exhaustion. create() is noexcept when T's constructor is.
+//
+// The factory must outlive all the objects it creates.
+//
+template <typename T, std::size_t Capacity>
+class staticObjectFactory final
+{
+  static_assert(Capacity > 0, "Capacity must be positive");
+
+public:
+  using handle = staticHandle<T, Capacity>;
+  // capacity, in use, high water mark, exhaustions
+  using staticFactoryCounters = std::tuple<std::size_t, std::size_t, std::size_t, unsigned long>;
+
+  constexpr staticObjectFactory() noexcept = default;
+
+  staticObjectFactory(const staticObjectFactory& rhs) = delete;
+  staticObjectFactory& operator=(const staticObjectFactory& rhs) = delete;
+  staticObjectFactory(staticObjectFactory&& rhs) = delete;
+  staticObjectFactory& operator=(staticObjectFactory&& rhs) = delete;
+
+  static constexpr std::size_t capacity() noexcept
+  {
+    return Capacity;
+  }
+
+  template <typename... Args>
+  handle create(Args&&... args) noexcept(std::is_nothrow_constructible_v<T, Args&&...>)
+  {
+    slot* s {acquire()};
+    if ( nullptr == s )
+    {
+      exhaustions_.fetch_add(1, std::memory_order_relaxed);
+      return handle {};
+    }
+    if constexpr ( std::is_nothrow_constructible_v<T, Args&&...> )
+    {
+      return makeHandle(::new (static_cast<void*>(s->storage_)) T(std::forward<Args>(args)...));
+    }
+    else
+    {
+      try
+      {
+        return makeHandle(::new (static_cast<void*>(s->storage_)) T(std::forward<Args>(args)...));
+      }
+      catch (...)
+      {
+        release(s);
+        throw;
+      }
+    }
+  }
+
+  auto getStaticFactoryCounters() const noexcept -> staticFactoryCounters
+  {
+    return std::make_tuple(Capacity,
+                           inUse_.load(std::memory_order_relaxed),
+                           highWater_.load(std::memory_order_relaxed),
+                           exhaustions_.load(std::memory_order_relaxed));
+  }
+
+private:
+  friend class staticHandle<T, Capacity>;
+
+  struct slot
+  {
+    alignas(T) unsigned char storage_[sizeof(T)];
+  };
+
+  handle makeHandle(T* object) noexcept
+  {
+    OBJECT_FACTORY_TRACE(factoryCreate, T, object);
+    return handle {this, object};
+  }
+
+  void lock() noexcept
+  {
+    while ( lock_.test_and_set(std::memory_order_acquire) )
+    {}
+  }
+
+  void unlock() noexcept
+  {
+    lock_.clear(std::memory_order_release);
+  }
+
+  slot* acquire() noexcept
+  {
+    lock();
+    std::size_t index {Capacity};
+    if ( 0 != freeTop_ )
+    {
+      index = freeIndexes_[--freeTop_];
+    }
+    else if ( nextUnused_ < Capacity )
+    {
+      index = nextUnused_++;
+    }
+    if ( Capacity != index )
+    {
+      const std::size_t inUse {inUse_.load(std::memory_order_relaxed) + 1};
+      inUse_.store(inUse, std::memory_order_relaxed);
+      if ( inUse > highWater_.load(std::memory_order_relaxed) )
+      {
+        highWater_.store(inUse, std::memory_order_relaxed);
+      }
+    }
+    unlock();
+    return (Capacity == index) ? nullptr : &slots_[index];
+  }
+
+  void release(slot* s) noexcept
+  {
+    lock();
+    freeIndexes_[freeTop_++] = static_cast<std::size_t>(s - slots_);
+    inUse_.store(inUse_.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+    unlock();
+  }
+
+  void destroy(T* object) noexcept
+  {
+    object->~T();
+    release(reinterpret_cast<slot*>(object));
+  }
+
+  slot slots_[Capacity] {};
+  std::size_t freeIndexes_[Capacity] {};
+  std::size_t freeTop_ {0};
+  std::size_t nextUnused_ {0};
+  std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+  std::atomic<std::size_t> inUse_ {0};
+  std::atomic<std::size_t> highWater_ {0};
+  std::atomic<unsigned long> exhaustions_ {0};
+};  // class staticObjectFactory
+
+template <typename T, std::size_t Capacity>
+using staticObjectFactoryFun = std::function<staticHandle<T, Capacity>(void)>;
+
+template <typename T, std::size_t Capacity, typename... Args>
+auto
+createStaticObjectFactoryFun(staticObjectFactory<T, Capacity>& factory, Args&&... args) noexcept -> staticObjectFactoryFun<T, Capacity>
+{
+  // the factory must outlive the function object and all the objects it
+  // creates; the function object returns empty handles when it is exhausted
+  return [&factory, args...]()
+         {
+           return factory.create(args...);
+         };
+}
+}  // namespace object_factory
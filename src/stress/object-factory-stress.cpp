@@ -0,0 +1,443 @@
+//
+// object-factory-stress.cpp
+//
+// Multi-threaded scalability harness for objectFactoryFun and objectCounter.
+//
+//   object-factory-stress [--threads 1,2,4,8] [--objects N] [--size 16|64|256|1024]
+//                         [--mode local|handoff] [--rate burst|steady]
+//                         [--burst N] [--ops-per-sec N]
+//
+// local:   each thread creates and immediately destroys its own objects
+// handoff: half of the threads create objects and pass them through queues to
+//          the other half, which destroy them; an odd thread count is rounded
+//          down to an even one, and at least 2 threads are used
+// burst:   objects are created in bursts of --burst objects, then the thread
+//          sleeps for 1 ms
+// steady:  each creating thread paces itself at --ops-per-sec objects per second
+//
+// For each thread count the harness prints the throughput and the p50/p99/p999
+// latency of creations and destructions, then checks the counter invariants.
+//
+#include "objectFactory.h"
+#include "object-counter.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+////////////////////////////////////////////////////////////////////////////////
+namespace
+{
+using namespace object_factory;
+using namespace object_factory::object_counter;
+using clockType = std::chrono::steady_clock;
+
+enum class stressMode
+{
+  local,
+  handoff
+};
+
+enum class stressRate
+{
+  burst,
+  steady
+};
+
+struct stressConfig
+{
+  std::vector<unsigned int> threads_ {1, 2, 4, 8};
+  unsigned long objects_ {1'000'000};
+  std::size_t size_ {64};
+  stressMode mode_ {stressMode::local};
+  stressRate rate_ {stressRate::burst};
+  unsigned long burst_ {10'000};
+  unsigned long opsPerSec_ {1'000'000};
+};
+
+template <std::size_t Size>
+class payload final : public objectCounter<payload<Size>>
+{
+  std::array<unsigned char, Size> bytes_ {};
+};  // class payload
+
+// latencies in ns of the operations of a thread
+using latencies = std::vector<std::uint64_t>;
+
+std::uint64_t
+elapsedNs(const clockType::time_point start, const clockType::time_point stop) noexcept
+{
+  return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+}
+
+// paces a creating thread according to the configured rate
+class pacer final
+{
+public:
+  explicit
+  pacer(const stressConfig& config) noexcept
+  :
+  config_(config)
+  {}
+
+  void wait(const unsigned long done) noexcept
+  {
+    if ( stressRate::burst == config_.rate_ )
+    {
+      if ( (0 != done) && (0 == done % config_.burst_) )
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      return;
+    }
+    const auto due {start_ + std::chrono::nanoseconds(done * 1'000'000'000ULL / config_.opsPerSec_)};
+    while ( clockType::now() < due )
+    {
+      std::this_thread::yield();
+    }
+  }
+
+private:
+  const stressConfig& config_;
+  const clockType::time_point start_ {clockType::now()};
+};  // class pacer
+
+// bounded queue handing objects over from a producer to a consumer
+template <typename Object>
+class handoffQueue final
+{
+public:
+  static constexpr std::size_t maxDepth_ {4'096};
+
+  void push(Object&& o)
+  {
+    std::unique_lock<std::mutex> ul(mtx_);
+    notFull_.wait(ul, [this] () { return queue_.size() < maxDepth_; });
+    queue_.push_back(std::move(o));
+    notEmpty_.notify_one();
+  }
+
+  // an empty object means the producer is done
+  Object pop()
+  {
+    std::unique_lock<std::mutex> ul(mtx_);
+    notEmpty_.wait(ul, [this] () { return !queue_.empty(); });
+    Object o {std::move(queue_.front())};
+    queue_.pop_front();
+    notFull_.notify_one();
+    return o;
+  }
+
+private:
+  std::mutex mtx_ {};
+  std::condition_variable notEmpty_ {};
+  std::condition_variable notFull_ {};
+  std::deque<Object> queue_ {};
+};  // class handoffQueue
+
+struct runResult
+{
+  double seconds_ {0.0};
+  latencies create_ {};
+  latencies destroy_ {};
+};
+
+template <typename T>
+runResult
+runLocal(const stressConfig& config, const unsigned int threads)
+{
+  const objectFactoryFun<T> factoryFun {createObjectFactoryFun<T>()};
+  const auto threadFun = [&config, &factoryFun] ()
+  {
+    std::pair<latencies, latencies> l {};
+    l.first.reserve(config.objects_);
+    l.second.reserve(config.objects_);
+    pacer p {config};
+    for (unsigned long i {0}; i < config.objects_; ++i)
+    {
+      p.wait(i);
+      const auto t0 {clockType::now()};
+      std::unique_ptr<T> o {factoryFun()};
+      const auto t1 {clockType::now()};
+      o.reset();
+      const auto t2 {clockType::now()};
+      l.first.push_back(elapsedNs(t0, t1));
+      l.second.push_back(elapsedNs(t1, t2));
+    }
+    return l;
+  };
+
+  runResult result {};
+  const auto start {clockType::now()};
+  std::vector<std::future<std::pair<latencies, latencies>>> futures {};
+  for (unsigned int i {0}; i < threads; ++i)
+  {
+    futures.push_back(std::async(std::launch::async, threadFun));
+  }
+  for (auto&& f : futures)
+  {
+    auto l {f.get()};
+    result.create_.insert(result.create_.end(), l.first.begin(), l.first.end());
+    result.destroy_.insert(result.destroy_.end(), l.second.begin(), l.second.end());
+  }
+  result.seconds_ = static_cast<double>(elapsedNs(start, clockType::now())) / 1e9;
+  return result;
+}
+
+template <typename T>
+runResult
+runHandoff(const stressConfig& config, const unsigned int threads)
+{
+  using Object = std::unique_ptr<T>;
+  const unsigned int pairs {std::max(1U, threads / 2)};
+  const objectFactoryFun<T> factoryFun {createObjectFactoryFun<T>()};
+  std::vector<handoffQueue<Object>> queues(pairs);
+
+  const auto producerFun = [&config, &factoryFun] (handoffQueue<Object>& queue)
+  {
+    latencies l {};
+    l.reserve(config.objects_);
+    pacer p {config};
+    for (unsigned long i {0}; i < config.objects_; ++i)
+    {
+      p.wait(i);
+      const auto t0 {clockType::now()};
+      Object o {factoryFun()};
+      l.push_back(elapsedNs(t0, clockType::now()));
+      queue.push(std::move(o));
+    }
+    queue.push(Object {});
+    return l;
+  };
+  const auto consumerFun = [&config] (handoffQueue<Object>& queue)
+  {
+    latencies l {};
+    l.reserve(config.objects_);
+    for (Object o {queue.pop()}; nullptr != o; o = queue.pop())
+    {
+      const auto t0 {clockType::now()};
+      o.reset();
+      l.push_back(elapsedNs(t0, clockType::now()));
+    }
+    return l;
+  };
+
+  runResult result {};
+  const auto start {clockType::now()};
+  std::vector<std::future<latencies>> producers {};
+  std::vector<std::future<latencies>> consumers {};
+  for (auto&& queue : queues)
+  {
+    consumers.push_back(std::async(std::launch::async, consumerFun, std::ref(queue)));
+    producers.push_back(std::async(std::launch::async, producerFun, std::ref(queue)));
+  }
+  for (auto&& f : producers)
+  {
+    const latencies l {f.get()};
+    result.create_.insert(result.create_.end(), l.begin(), l.end());
+  }
+  for (auto&& f : consumers)
+  {
+    const latencies l {f.get()};
+    result.destroy_.insert(result.destroy_.end(), l.begin(), l.end());
+  }
+  result.seconds_ = static_cast<double>(elapsedNs(start, clockType::now())) / 1e9;
+  return result;
+}
+
+std::uint64_t
+percentile(const latencies& sorted, const double p) noexcept
+{
+  if ( sorted.empty() )
+  {
+    return 0;
+  }
+  const auto index {static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1))};
+  return sorted[index];
+}
+
+void
+printLatencies(const std::string& what, latencies& l)
+{
+  std::sort(l.begin(), l.end());
+  std::cout << "  " << std::left << std::setw(8) << what << std::right
+            << " p50 " << std::setw(8) << percentile(l, 0.50) << " ns"
+            << "  p99 " << std::setw(8) << percentile(l, 0.99) << " ns"
+            << "  p999 " << std::setw(8) << percentile(l, 0.999) << " ns"
+            << '\n';
+}
+
+// check the counters of T after a run; return false if an invariant is broken
+template <typename T>
+bool
+checkInvariants(const unsigned long expectedObjects)
+{
+  const auto [objectsCreated, objectsAlive, objectsDestroyed, tooManyDestructions] = T::getObjectCounters();
+  const bool ok {(0 == objectsAlive) &&
+                 (expectedObjects == objectsCreated) &&
+                 (expectedObjects == objectsDestroyed) &&
+                 !tooManyDestructions};
+  std::cout << "  counters: created " << objectsCreated
+            << " alive " << objectsAlive
+            << " destroyed " << objectsDestroyed
+            << " too many destructions " << std::boolalpha << tooManyDestructions
+            << (ok ? "  [OK]" : "  [BROKEN INVARIANTS]")
+            << std::endl;
+  return ok;
+}
+
+template <typename T>
+bool
+runAll(const stressConfig& config)
+{
+  bool ok {true};
+  for (auto&& threads : config.threads_)
+  {
+    T::resetCounters();
+    runResult r {(stressMode::local == config.mode_) ? runLocal<T>(config, threads)
+                                                      : runHandoff<T>(config, threads)};
+    // the thread counts actually run, which in handoff mode differ from the
+    // requested one when it is odd or 1
+    const unsigned long creatingThreads {(stressMode::local == config.mode_) ? threads
+                                                                              : std::max(1U, threads / 2)};
+    const unsigned long usedThreads {(stressMode::local == config.mode_) ? creatingThreads
+                                                                          : 2 * creatingThreads};
+    const unsigned long objects {creatingThreads * config.objects_};
+
+    std::cout << "threads " << usedThreads
+              << " - objects " << objects
+              << " - " << std::fixed << std::setprecision(3) << r.seconds_ << " s"
+              << " - " << std::setprecision(0) << static_cast<double>(objects) / r.seconds_ << " objects/s"
+              << '\n';
+    printLatencies("create", r.create_);
+    printLatencies("destroy", r.destroy_);
+    ok = checkInvariants<T>(objects) && ok;
+  }
+  return ok;
+}
+
+std::vector<unsigned int>
+parseThreads(const std::string& list)
+{
+  std::vector<unsigned int> threads {};
+  std::istringstream iss(list);
+  std::string item {};
+  while ( std::getline(iss, item, ',') )
+  {
+    threads.push_back(static_cast<unsigned int>(std::max(1UL, std::stoul(item))));
+  }
+  if ( threads.empty() )
+  {
+    throw std::invalid_argument("Empty thread count list");
+  }
+  return threads;
+}
+
+stressConfig
+parseArguments(const int argc, char* argv[])
+{
+  stressConfig config {};
+  for (int i {1}; i < argc; i += 2)
+  {
+    const std::string option {argv[i]};
+    if ( i + 1 == argc )
+    {
+      throw std::invalid_argument("Missing value for option " + option);
+    }
+    const std::string value {argv[i + 1]};
+    if ( "--threads" == option )
+    {
+      config.threads_ = parseThreads(value);
+    }
+    else if ( "--objects" == option )
+    {
+      config.objects_ = std::stoul(value);
+    }
+    else if ( "--size" == option )
+    {
+      config.size_ = std::stoul(value);
+    }
+    else if ( "--mode" == option )
+    {
+      if ( ("local" != value) && ("handoff" != value) )
+      {
+        throw std::invalid_argument("Unsupported mode " + value);
+      }
+      config.mode_ = ("handoff" == value) ? stressMode::handoff : stressMode::local;
+    }
+    else if ( "--rate" == option )
+    {
+      if ( ("burst" != value) && ("steady" != value) )
+      {
+        throw std::invalid_argument("Unsupported rate " + value);
+      }
+      config.rate_ = ("steady" == value) ? stressRate::steady : stressRate::burst;
+    }
+    else if ( "--burst" == option )
+    {
+      config.burst_ = std::max(1UL, std::stoul(value));
+    }
+    else if ( "--ops-per-sec" == option )
+    {
+      config.opsPerSec_ = std::max(1UL, std::stoul(value));
+    }
+    else
+    {
+      throw std::invalid_argument("Unknown option " + option);
+    }
+  }
+  return config;
+}
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int
+{
+  try
+  {
+    const stressConfig config {parseArguments(argc, argv)};
+
+    std::clog << "\n[" << __func__ << "] "
+              << "Object Factory Stress STARTED"
+              << std::endl;
+
+    bool ok {false};
+    switch (config.size_)
+    {
+      case 16:
+        ok = runAll<payload<16>>(config);
+        break;
+      case 64:
+        ok = runAll<payload<64>>(config);
+        break;
+      case 256:
+        ok = runAll<payload<256>>(config);
+        break;
+      case 1024:
+        ok = runAll<payload<1024>>(config);
+        break;
+      default:
+        throw std::invalid_argument("Unsupported object size " + std::to_string(config.size_));
+    }
+
+    std::clog << "\n[" << __func__ << "] "
+              << "TERMINATED"
+              << std::endl;
+    return ok ? 0 : 2;
+  }
+  catch (const std::exception& e)
+  {
+    std::cerr << "[" << __func__ << "] "
+              << "EXCEPTION: "
+              << e.what()
+              << '\n';
+    return 1;
+  }
+}  // main
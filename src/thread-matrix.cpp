@@ -0,0 +1,32 @@
+//
+// thread-matrix.cpp
+//
+#include "thread-matrix.h"
+#include <algorithm>
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory::object_counter
+{
+namespace
+{
+std::atomic<std::size_t> nextThreadIndex {0};
+
+// constant initialized: no index yet
+thread_local std::size_t threadIndex {overflowThreadIndex + 1};
+}  // namespace
+
+std::size_t
+trackedThreadIndex() noexcept
+{
+  if ( threadIndex > overflowThreadIndex )
+  {
+    threadIndex = std::min(nextThreadIndex.fetch_add(1, std::memory_order_relaxed), overflowThreadIndex);
+  }
+  return threadIndex;
+}
+
+std::size_t
+trackedThreadCount() noexcept
+{
+  return std::min(nextThreadIndex.load(std::memory_order_relaxed), maxTrackedThreads);
+}
+}  // namespace object_factory::object_counter
@@ -0,0 +1,152 @@
+//
+// thread-matrix.h
+//
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+////////////////////////////////////////////////////////////////////////////////
+namespace object_factory::object_counter
+{
+// threads beyond the first maxTrackedThreads ever tracked share a single
+// overflow index; indexes are not recycled when threads exit, since the
+// objects created by a thread may be destroyed after it is gone
+constexpr std::size_t maxTrackedThreads {64};
+constexpr std::size_t overflowThreadIndex {maxTrackedThreads};
+
+// a dense index of the calling thread, given the first time it asks for it:
+// in [0, maxTrackedThreads), or overflowThreadIndex
+std::size_t trackedThreadIndex() noexcept;
+
+// the number of indexes given so far, at most maxTrackedThreads
+std::size_t trackedThreadCount() noexcept;
+
+// the creator thread of an object, stored only when thread tracking is on:
+// the empty specialization costs nothing as a base class
+template <bool enabled>
+class creatorThread
+{
+protected:
+  ~creatorThread() = default;
+};
+
+template <>
+class creatorThread<true>
+{
+protected:
+  // copies and moves are new objects, created by the calling thread
+  creatorThread() noexcept
+  :
+  creatorIndex_(static_cast<std::uint32_t>(trackedThreadIndex()))
+  {}
+
+  creatorThread([[maybe_unused]] const creatorThread& rhs) noexcept
+  :
+  creatorThread()
+  {}
+
+  // assignment does not change the identity of an object
+  creatorThread& operator=([[maybe_unused]] const creatorThread& rhs) noexcept
+  {
+    return *this;
+  }
+
+  ~creatorThread() = default;
+
+  std::size_t creatorIndex() const noexcept
+  {
+    return creatorIndex_;
+  }
+
+private:
+  std::uint32_t creatorIndex_;
+};  // class creatorThread<true>
+
+// the creator -> destroyer counts of a threadMatrix at some point in time
+struct threadMatrixSnapshot
+{
+  static constexpr std::size_t size {maxTrackedThreads + 1};
+
+  // destructions of objects created by thread creator and destroyed by
+  // thread destroyer, by their tracked thread index
+  unsigned long count(std::size_t creator, std::size_t destroyer) const noexcept
+  {
+    return counts_[creator * size + destroyer];
+  }
+
+  // the fraction of the attributed destructions run by a thread other than
+  // the creator
+  double remoteFreeRatio() const noexcept
+  {
+    const unsigned long total {localFrees_ + remoteFrees_};
+    return (0 == total) ? 0.0 : static_cast<double>(remoteFrees_) / static_cast<double>(total);
+  }
+
+  std::vector<unsigned long> counts_;
+  // destructions by the creator thread
+  unsigned long localFrees_;
+  // destructions by another thread, including those between a tracked thread
+  // and an overflow one, which are certainly different threads
+  unsigned long remoteFrees_;
+  // destructions with both creator and destroyer on the overflow index: they
+  // may or may not be the same thread, so they are neither local nor remote
+  unsigned long unattributedFrees_;
+};  // struct threadMatrixSnapshot
+
+//
+// Counts of the destructions of the objects of a type by creator and
+// destroyer thread. Each destruction is a relaxed increment of one cell, so
+// a snapshot taken while objects are being destroyed is not consistent
+// across cells.
+//
+template <typename counterType>
+class threadMatrix final
+{
+public:
+  static constexpr std::size_t size {threadMatrixSnapshot::size};
+
+  void record(const std::size_t creator, const std::size_t destroyer) noexcept
+  {
+    cells_[creator * size + destroyer].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  threadMatrixSnapshot snapshot() const
+  {
+    threadMatrixSnapshot s {std::vector<unsigned long>(size * size), 0, 0, 0};
+    for (std::size_t creator {0}; creator < size; ++creator)
+    {
+      for (std::size_t destroyer {0}; destroyer < size; ++destroyer)
+      {
+        const unsigned long n {cells_[creator * size + destroyer].load(std::memory_order_relaxed)};
+        s.counts_[creator * size + destroyer] = n;
+        if ( creator != destroyer )
+        {
+          s.remoteFrees_ += n;
+        }
+        else if ( overflowThreadIndex != creator )
+        {
+          s.localFrees_ += n;
+        }
+        else
+        {
+          s.unattributedFrees_ += n;
+        }
+      }
+    }
+    return s;
+  }
+
+  void reset() noexcept
+  {
+    for (auto&& cell : cells_)
+    {
+      cell.store(0, std::memory_order_relaxed);
+    }
+  }
+
+private:
+  std::atomic<counterType> cells_[size * size] {};
+};  // class threadMatrix
+}  // namespace object_factory::object_counter
@@ -3,7 +3,21 @@
 //
 #include "../object-counter.h"
 #include "../objectFactory.h"
+#include "../deferred-reclaimer.h"
+#include "../cow-value.h"
+#include "../object-pool.h"
+#include "../object-trace.h"
+#include "../shared-counters.h"
+#include "../allocation-tracker.h"
+#include "../record-stream.h"
+#include "../inline-poly.h"
+#include "../object-interner.h"
+#include "../alive-quota.h"
+#include "../static-object-factory.h"
+#include <fstream>
 #include <future>
+#include <unistd.h>
+#include <sys/wait.h>
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
@@ -13,6 +27,46 @@
 #pragma clang diagnostic ignored "-Wzero-as-null-pointer-constant"
 
 using namespace ::testing;
+
+// succeed if f performs exactly expectedAllocations heap allocations on the
+// calling thread
+template <typename F>
+AssertionResult
+allocates(const unsigned long expectedAllocations, F&& f)
+{
+  object_factory::allocation_tracker::allocationBudget budget {expectedAllocations};
+  f();
+  const unsigned long allocations {budget.allocations()};
+  if ( expectedAllocations == allocations )
+  {
+    return AssertionSuccess();
+  }
+  return AssertionFailure() << allocations
+                            << " allocations performed, "
+                            << expectedAllocations
+                            << " expected";
+}
+
+// as allocates, but without allocation tracking f is just run: for tests
+// checking more than the allocations
+template <typename F>
+AssertionResult
+allocatesIfTracked(const unsigned long expectedAllocations, F&& f)
+{
+  if ( !object_factory::allocation_tracker::trackingEnabled() )
+  {
+    f();
+    return AssertionSuccess();
+  }
+  return allocates(expectedAllocations, std::forward<F>(f));
+}
+
+// skip the test if operator new/delete are not tracked
+#define SKIP_WITHOUT_ALLOCATION_TRACKING() \
+  if ( !object_factory::allocation_tracker::trackingEnabled() ) \
+  { \
+    GTEST_SKIP(); \
+  }
 ////////////////////////////////////////////////////////////////////////////////
 // Tests
 TEST (objectFactory, test_1)
@@ -716,5 +770,1587 @@ TEST (objectFactory, test_6)
   ASSERT_EQ(moveAssignments_A, A::getMoveAssignmentsCounter());
 }
 
+// test deferred destruction of objects through a deferredReclaimer
+TEST (objectFactory, test_7)
+{
+  using namespace object_factory::object_counter;
+
+  // written by the threads running the destructors of A, concurrently when
+  // the reclaimer queue is full
+  static std::atomic<std::thread::id> destroyerThreadId {};
+
+  class A final : public objectCounter<A>
+  {
+   public:
+    ~A()
+    {
+      destroyerThreadId.store(std::this_thread::get_id(), std::memory_order_relaxed);
+    }
+  };
+
+  const unsigned long objectsToCreate {1'000};
+
+  {
+    object_factory::deferredReclaimer reclaimer {};
+    object_factory::deferredObjectFactoryFun<A> objectFactoryFun =
+            object_factory::createDeferredObjectFactoryFun<A>(reclaimer);
+    using Object = object_factory::deferredUniquePtr<A>;
+
+    {
+      std::vector<Object> v {};
+      for (unsigned long i {1}; i <= objectsToCreate; ++i)
+      {
+        v.push_back(objectFactoryFun());
+      }
+      ASSERT_EQ(objectsToCreate, A::getObjectsAliveCounter());
+      ASSERT_EQ(0, A::getObjectsRetiredCounter());
+    }  // the objects in the vector v are retired here, not destroyed
+
+    reclaimer.drain();
+
+    auto [objectsCreated, objectsAlive, objectsDestroyed, tooManyDestructions] = A::getObjectCounters();
+    ASSERT_EQ(0, objectsAlive);
+    ASSERT_EQ(objectsToCreate, objectsCreated);
+    ASSERT_EQ(objectsToCreate, objectsDestroyed);
+    ASSERT_EQ(false, tooManyDestructions);
+    ASSERT_EQ(0, A::getObjectsRetiredCounter());
+    ASSERT_NE(std::this_thread::get_id(), destroyerThreadId.load(std::memory_order_relaxed));
+
+    auto [retired, reclaimed, inlineDestructions, maxQueueDepth] = reclaimer.getReclaimerCounters();
+    ASSERT_EQ(objectsToCreate, retired);
+    ASSERT_EQ(objectsToCreate, reclaimed);
+    ASSERT_EQ(0, inlineDestructions);
+    ASSERT_LE(maxQueueDepth, 1'024);
+  }
+
+  // a queue of depth 1 forces inline destructions when the reclaimer is busy;
+  // all objects must be destroyed exactly once anyway
+  A::resetCounters();
+  {
+    object_factory::deferredReclaimer reclaimer {1};
+    {
+      std::vector<object_factory::deferredUniquePtr<A>> v {};
+      for (unsigned long i {1}; i <= objectsToCreate; ++i)
+      {
+        v.push_back(object_factory::createDeferredUniquePtr<A>(reclaimer));
+      }
+    }
+  }  // the reclaimer destroys all objects still queued
+
+  auto [objectsCreated, objectsAlive, objectsDestroyed, tooManyDestructions] = A::getObjectCounters();
+  ASSERT_EQ(0, objectsAlive);
+  ASSERT_EQ(objectsToCreate, objectsCreated);
+  ASSERT_EQ(objectsToCreate, objectsDestroyed);
+  ASSERT_EQ(false, tooManyDestructions);
+  ASSERT_EQ(0, A::getObjectsRetiredCounter());
+
+  // a reset while retired objects are still queued doesn't wrap the retired
+  // counter when they are reclaimed
+  {
+    object_factory::deferredReclaimer reclaimer {};
+    {
+      std::vector<object_factory::deferredUniquePtr<A>> v {};
+      for (unsigned long i {1}; i <= objectsToCreate; ++i)
+      {
+        v.push_back(object_factory::createDeferredUniquePtr<A>(reclaimer));
+      }
+    }
+    A::resetCounters();
+    reclaimer.drain();
+    ASSERT_EQ(0, A::getObjectsRetiredCounter());
+  }
+}
+
+// test the prototype factory: objects are copies of a prototype built once
+TEST (objectFactory, test_8)
+{
+  using namespace object_factory::object_counter;
+
+  class A final : public objectCounter<A>
+  {
+    int _x{};
+    object_factory::cowValue<std::vector<int>> _v;
+
+   public:
+    explicit
+    A(const int x) noexcept(false)
+    :
+    _x(x),
+    _v(std::vector<int>(100, x))
+    {}
+
+    int get_x() const noexcept
+    {
+      return _x;
+    }
+
+    const std::vector<int>& get_v() const noexcept
+    {
+      return _v.get();
+    }
+
+    bool sharesV() const noexcept
+    {
+      return _v.isShared();
+    }
+
+    void set_v(const std::size_t i, const int value)
+    {
+      _v.write()[i] = value;
+    }
+  };
+
+  const unsigned long objectsToCreate {10};
+
+  {
+    object_factory::objectFactoryFun<A> objectFactoryFun = object_factory::createPrototypeFactoryFun<A>(42);
+    using Object = std::unique_ptr<A>;
+
+    // the prototype only
+    ASSERT_EQ(1, A::getObjectsCreatedCounter());
+    ASSERT_EQ(0, A::getCopyConstructionsCounter());
+
+    std::vector<Object> v {};
+    for (unsigned long i {1}; i <= objectsToCreate; ++i)
+    {
+      v.push_back(objectFactoryFun());
+    }
+
+    ASSERT_EQ(objectsToCreate + 1, A::getObjectsCreatedCounter());
+    ASSERT_EQ(objectsToCreate + 1, A::getObjectsAliveCounter());
+    ASSERT_EQ(objectsToCreate, A::getCopyConstructionsCounter());
+
+    for (auto&& item : v)
+    {
+      ASSERT_EQ(42, item->get_x());
+      ASSERT_EQ(42, item->get_v()[0]);
+      ASSERT_TRUE(item->sharesV());
+    }
+    // the heavy member is shared with the prototype and all the other copies
+    ASSERT_EQ(&v[0]->get_v(), &v[1]->get_v());
+
+    // writing clones the heavy member of the written object only
+    v[0]->set_v(0, 7);
+    ASSERT_EQ(7, v[0]->get_v()[0]);
+    ASSERT_EQ(42, v[1]->get_v()[0]);
+    ASSERT_NE(&v[0]->get_v(), &v[1]->get_v());
+    ASSERT_FALSE(v[0]->sharesV());
+
+    // new objects are not affected
+    Object o = objectFactoryFun();
+    ASSERT_EQ(42, o->get_v()[0]);
+
+    // a copy made, read and destroyed by another thread leaves the value
+    // unshared again, so it is then written in place
+    const std::vector<int>* const written {&v[0]->get_v()};
+    std::future<int> reader {std::async(std::launch::async,
+                                        [&source = *v[0]] () { const A copy {source}; return copy.get_v()[0]; })};
+    ASSERT_EQ(7, reader.get());
+    ASSERT_FALSE(v[0]->sharesV());
+    v[0]->set_v(1, 8);
+    ASSERT_EQ(written, &v[0]->get_v());
+  }  // objects and prototype destroyed
+
+  auto [objectsCreated, objectsAlive, objectsDestroyed, tooManyDestructions] = A::getObjectCounters();
+  ASSERT_EQ(0, objectsAlive);
+  ASSERT_EQ(objectsToCreate + 3, objectsCreated);
+  ASSERT_EQ(objectsToCreate + 3, objectsDestroyed);
+  ASSERT_EQ(false, tooManyDestructions);
+}
+
+// test the pooled factory with simulated NUMA nodes: objects created on a
+// node and destroyed on another one go back to the arena of their node
+TEST (objectFactory, test_9)
+{
+  using namespace object_factory::object_counter;
+
+  class A final : public objectCounter<A>
+  {
+    int _x{};
+
+   public:
+    explicit
+    A(const int x) noexcept
+    :
+    _x(x)
+    {}
+
+    int get_x() const noexcept
+    {
+      return _x;
+    }
+  };
+
+  const std::size_t nodes {4};
+  const std::size_t slotsPerChunk {64};
+  const unsigned long objectsPerNode {1'000};
+
+  object_factory::objectPool<A> pool {nodes, &object_factory::simulatedNumaNode, slotsPerChunk};
+  object_factory::pooledObjectFactoryFun<A> objectFactoryFun =
+          object_factory::createPooledObjectFactoryFun<A>(pool, 7);
+  using Object = object_factory::pooledUniquePtr<A>;
+
+  // objects created by producers on each node are handed over to a consumer
+  // on the next node
+  std::vector<std::vector<Object>> handOver(nodes);
+
+  std::vector<std::future<void>> producers {};
+  for (std::size_t node {0}; node < nodes; ++node)
+  {
+    producers.push_back(std::async(std::launch::async, [&, node] ()
+    {
+      object_factory::simulatedNumaNodeScope scope {node};
+      for (unsigned long i {1}; i <= objectsPerNode; ++i)
+      {
+        handOver[node].push_back(objectFactoryFun());
+      }
+    }));
+  }
+  for (auto&& item : producers)
+  {
+    item.get();
+  }
+
+  ASSERT_EQ(nodes * objectsPerNode, A::getObjectsAliveCounter());
+  for (std::size_t node {0}; node < nodes; ++node)
+  {
+    auto [allocations, localFrees, remoteFrees, chunks] = pool.getNodeCounters(node);
+    ASSERT_EQ(objectsPerNode, allocations);
+    ASSERT_EQ(0, localFrees);
+    ASSERT_EQ(0, remoteFrees);
+    ASSERT_EQ((objectsPerNode + slotsPerChunk - 1) / slotsPerChunk, chunks);
+  }
+
+  std::vector<std::future<void>> consumers {};
+  for (std::size_t node {0}; node < nodes; ++node)
+  {
+    consumers.push_back(std::async(std::launch::async, [&, node] ()
+    {
+      object_factory::simulatedNumaNodeScope scope {(node + 1) % nodes};
+      for (auto&& o : handOver[node])
+      {
+        ASSERT_EQ(7, o->get_x());
+        o.reset();
+      }
+    }));
+  }
+  for (auto&& item : consumers)
+  {
+    item.get();
+  }
+
+  auto [objectsCreated, objectsAlive, objectsDestroyed, tooManyDestructions] = A::getObjectCounters();
+  ASSERT_EQ(0, objectsAlive);
+  ASSERT_EQ(nodes * objectsPerNode, objectsCreated);
+  ASSERT_EQ(nodes * objectsPerNode, objectsDestroyed);
+  ASSERT_EQ(false, tooManyDestructions);
+
+  auto [allocations, localFrees, remoteFrees, chunks] = pool.getPoolCounters();
+  ASSERT_EQ(nodes * objectsPerNode, allocations);
+  ASSERT_EQ(0, localFrees);
+  ASSERT_EQ(nodes * objectsPerNode, remoteFrees);
+
+  // the remotely freed slots are reused by their own node: no new chunks
+  {
+    object_factory::simulatedNumaNodeScope scope {1};
+    std::vector<Object> v {};
+    for (unsigned long i {1}; i <= objectsPerNode; ++i)
+    {
+      v.push_back(objectFactoryFun());
+    }
+    auto [allocations_1, localFrees_1, remoteFrees_1, chunks_1] = pool.getNodeCounters(1);
+    ASSERT_EQ(2 * objectsPerNode, allocations_1);
+    ASSERT_EQ(std::get<3>(pool.getPoolCounters()), chunks);
+  }  // local frees
+  ASSERT_EQ(objectsPerNode, std::get<1>(pool.getNodeCounters(1)));
+  ASSERT_GE(object_factory::numaNodeCount(), 1);
+}
+
+// test the tracing hooks and the ring buffer sink
+TEST (objectFactory, test_10)
+{
+  using namespace object_factory::object_counter;
+  using namespace object_factory::object_trace;
+
+  class A final : public objectCounter<A>
+  {};
+
+  ringBufferSink::clear();
+  setTraceHook(&ringBufferSink::record);
+  {
+    object_factory::objectFactoryFun<A> objectFactoryFun = object_factory::createObjectFactoryFun<A>();
+    std::unique_ptr<A> o = objectFactoryFun();
+    A a {*o};
+  }
+  setTraceHook(nullptr);
+
+  std::vector<traceEvent> events {ringBufferSink::collect()};
+#if defined(OBJECT_FACTORY_TRACING)
+  // construction, factoryCreate, copyConstruction, destruction x 2
+  ASSERT_EQ(5, events.size());
+  ASSERT_EQ(traceEventKind::construction, events[0].kind_);
+  ASSERT_EQ(traceEventKind::factoryCreate, events[1].kind_);
+  ASSERT_EQ(traceEventKind::copyConstruction, events[2].kind_);
+  ASSERT_EQ(traceEventKind::destruction, events[3].kind_);
+  ASSERT_EQ(traceEventKind::destruction, events[4].kind_);
+  ASSERT_STREQ(typeid(A).name(), events[0].typeName_);
+#else
+  // hooks compiled out
+  ASSERT_EQ(0, events.size());
+#endif
+
+  // events can be emitted and recorded explicitly as well, from any thread
+  ringBufferSink::clear();
+  setTraceHook(&ringBufferSink::record);
+  int object {};
+  emitTraceEvent(traceEventKind::construction, "\"quoted\"", &object);
+  std::async(std::launch::async, [&object] ()
+  {
+    emitTraceEvent(traceEventKind::destruction, "\"quoted\"", &object);
+  }).get();
+  setTraceHook(nullptr);
+  // no hook, no events
+  emitTraceEvent(traceEventKind::construction, "ignored", &object);
+
+  events = ringBufferSink::collect();
+  ASSERT_EQ(2, events.size());
+  ASSERT_NE(events[0].threadId_, events[1].threadId_);
+  ASSERT_LE(events[0].timestampNs_, events[1].timestampNs_);
+  ASSERT_EQ(&object, events[1].object_);
+
+  const std::string chromeTraceFile {"/tmp/object-factory-test_10-" + std::to_string(::getpid()) + ".json"};
+  ASSERT_EQ(2, ringBufferSink::dumpChromeTrace(chromeTraceFile));
+  {
+    std::ifstream ifs(chromeTraceFile);
+    const std::string json {std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()};
+    ASSERT_THAT(json, StartsWith("{\"traceEvents\":["));
+    ASSERT_THAT(json, HasSubstr("\"name\":\"destruction\""));
+    ASSERT_THAT(json, HasSubstr("\"cat\":\"\\\"quoted\\\"\""));
+  }
+
+  const std::string binaryTraceFile {"/tmp/object-factory-test_10-" + std::to_string(::getpid()) + ".bin"};
+  ASSERT_EQ(2, ringBufferSink::dumpBinary(binaryTraceFile));
+  {
+    std::ifstream ifs(binaryTraceFile, std::ios::binary);
+    const std::string bin {std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()};
+    // header + 2 * (fixed size fields + type name)
+    ASSERT_EQ(16 + 2 * (23 + std::string("\"quoted\"").size()), bin.size());
+    ASSERT_EQ("OFTRACE1", bin.substr(0, 8));
+  }
+
+  std::remove(chromeTraceFile.c_str());
+  std::remove(binaryTraceFile.c_str());
+
+  // the rings of terminated threads are reused, not accumulated
+  ringBufferSink::clear();
+  ringBufferSink::setCapacity(4);
+  ringBufferSink::reserve(1);
+  setTraceHook(&ringBufferSink::record);
+  const std::size_t rings {ringBufferSink::ringCount()};
+  for (int t {0}; t < 10; ++t)
+  {
+    std::thread([&object] ()
+    {
+      for (int i {0}; i < 10; ++i)
+      {
+        emitTraceEvent(traceEventKind::construction, "churn", &object);
+      }
+    }).join();
+  }
+  setTraceHook(nullptr);
+  ASSERT_EQ(rings, ringBufferSink::ringCount());
+  // only the last thread's events, in a ring of the new capacity
+  ASSERT_EQ(4, ringBufferSink::collect().size());
+
+  ringBufferSink::setCapacity(ringBufferSink::defaultCapacity_);
+  ringBufferSink::clear();
+}
+
+// test consistent snapshots of the counters read while other threads write them
+TEST (objectFactory, test_11)
+{
+  using namespace object_factory::object_counter;
+
+  class A final : public objectCounter<A>
+  {};
+
+  const unsigned long objectsToCreate {200'000};
+  const unsigned int threadNumber {4};
+  std::atomic<bool> writersDone {false};
+
+  const
+  auto
+  writerFun = [] (const unsigned long objs)
+  {
+    for (unsigned long i {1}; i <= objs; ++i)
+    {
+      A a {};
+      A b {a};
+      A c {std::move(b)};
+    }
+  };
+
+  const
+  auto
+  readerFun = [&writersDone, threadNumber] ()
+  {
+    unsigned long snapshots {0};
+    unsigned long previousCreated {0};
+    while ( !writersDone.load() )
+    {
+      auto [objectsCreated, objectsAlive, objectsDestroyed, tooManyDestructions,
+            copyConstructions, copyAssignments, moveConstructions, moveAssignments] = A::getAllCounters();
+      // invariants holding in any consistent snapshot
+      EXPECT_EQ(objectsCreated, objectsAlive + objectsDestroyed);
+      // each writer copy constructs before move constructing
+      EXPECT_GE(copyConstructions, moveConstructions);
+      EXPECT_LE(copyConstructions - moveConstructions, threadNumber);
+      EXPECT_GE(objectsCreated, previousCreated);
+      EXPECT_EQ(false, tooManyDestructions);
+      EXPECT_EQ(0, copyAssignments);
+      EXPECT_EQ(0, moveAssignments);
+      previousCreated = objectsCreated;
+      ++snapshots;
+    }
+    return snapshots;
+  };
+
+  std::future<unsigned long> reader {std::async(std::launch::async, readerFun)};
+  std::vector<std::future<void>> writers {};
+  for (unsigned int i {1}; i <= threadNumber; ++i)
+  {
+    writers.push_back(std::async(std::launch::async, writerFun, objectsToCreate));
+  }
+  for (auto&& item : writers)
+  {
+    item.get();
+  }
+  writersDone = true;
+  ASSERT_GT(reader.get(), 0);
+
+  auto [objectsCreated, objectsAlive, objectsDestroyed, tooManyDestructions,
+        copyConstructions, copyAssignments, moveConstructions, moveAssignments] = A::getAllCounters();
+  ASSERT_EQ(0, objectsAlive);
+  ASSERT_EQ(3 * threadNumber * objectsToCreate, objectsCreated);
+  ASSERT_EQ(3 * threadNumber * objectsToCreate, objectsDestroyed);
+  ASSERT_EQ(false, tooManyDestructions);
+  ASSERT_EQ(threadNumber * objectsToCreate, copyConstructions);
+  ASSERT_EQ(threadNumber * objectsToCreate, moveConstructions);
+  ASSERT_EQ(std::make_tuple(objectsCreated, objectsAlive, objectsDestroyed, tooManyDestructions),
+            A::getObjectCounters());
+  ASSERT_EQ(std::make_tuple(copyConstructions, copyAssignments, moveConstructions, moveAssignments),
+            A::getCopyMoveCounters());
+}
+
+// test the export of the counters to a shared memory segment
+TEST (objectFactory, test_12)
+{
+  using namespace object_factory::object_counter;
+
+  class A final : public objectCounter<A>
+  {};
+  class B final : public objectCounter<B>
+  {};
+
+  const std::string segmentName {"/object-factory-test_12-" + std::to_string(::getpid())};
+  {
+    sharedCounterSegment segment {segmentName, 2};
+    A::exportToSharedMemory(segment, "A");
+    B::exportToSharedMemory(segment, "B");
+    // no room left
+    EXPECT_THROW(segment.allocateSlot("C"), std::length_error);
+
+    std::vector<sharedCounterSnapshot> snapshots {readSharedCounters(segmentName)};
+    ASSERT_EQ(2, snapshots.size());
+    ASSERT_EQ("A", snapshots[0].typeName_);
+    ASSERT_EQ("B", snapshots[1].typeName_);
+    ASSERT_EQ(0, snapshots[0].values_[objectsCreatedIndex]);
+
+    {
+      A a1 {};
+      A a2 {a1};
+      A a3 {std::move(a2)};
+      B b {};
+
+      snapshots = readSharedCounters(segmentName);
+      ASSERT_EQ(3, snapshots[0].values_[objectsCreatedIndex]);
+      ASSERT_EQ(3, snapshots[0].values_[objectsAliveIndex]);
+      ASSERT_EQ(0, snapshots[0].values_[objectsDestroyedIndex]);
+      ASSERT_EQ(1, snapshots[0].values_[copyConstructionsIndex]);
+      ASSERT_EQ(1, snapshots[0].values_[moveConstructionsIndex]);
+      ASSERT_EQ(1, snapshots[1].values_[objectsAliveIndex]);
+    }
+
+    snapshots = readSharedCounters(segmentName);
+    ASSERT_EQ(0, snapshots[0].values_[objectsAliveIndex]);
+    ASSERT_EQ(3, snapshots[0].values_[objectsDestroyedIndex]);
+    ASSERT_EQ(0, snapshots[0].values_[tooManyDestructionsIndex]);
+    ASSERT_EQ(1, snapshots[1].values_[objectsDestroyedIndex]);
+
+    // the name is taken while the segment is alive
+    try
+    {
+      sharedCounterSegment duplicate {segmentName, 2};
+      FAIL() << "segment created twice";
+    }
+    catch (const std::system_error& e)
+    {
+      ASSERT_EQ(std::errc::file_exists, e.code());
+    }
+
+    // counters are no longer exported
+    A::stopSharedMemoryExport();
+    B::stopSharedMemoryExport();
+    A a {};
+    ASSERT_EQ(3, readSharedCounters(segmentName)[0].values_[objectsCreatedIndex]);
+  }  // the segment is removed
+
+  EXPECT_THROW(readSharedCounters(segmentName), std::system_error);
+
+  // counters still exported when their segment is destroyed stop writing there
+  {
+    sharedCounterSegment segment {segmentName, 2};
+    A::exportToSharedMemory(segment, "A");
+    A a {};
+    ASSERT_EQ(1, readSharedCounters(segmentName)[0].values_[objectsAliveIndex]);
+  }
+  {
+    A a {};
+    A copy {a};
+  }
+  ASSERT_EQ(0, A::getObjectsAliveCounter());
+
+  // a segment left behind by a dead process is replaced
+  const pid_t child {::fork()};
+  ASSERT_NE(-1, child);
+  if ( 0 == child )
+  {
+    new sharedCounterSegment {segmentName, 2};
+    ::_exit(0);
+  }
+  int status {0};
+  ASSERT_EQ(child, ::waitpid(child, &status, 0));
+  ASSERT_NO_THROW(readSharedCounters(segmentName));
+  {
+    sharedCounterSegment segment {segmentName, 1};
+    ASSERT_EQ(0, readSharedCounters(segmentName).size());
+  }
+  EXPECT_THROW(readSharedCounters(segmentName), std::system_error);
+}
+
+// pin down the allocations done by the factories; the expected values hold
+// with libstdc++, whose std::function stores trivially copyable function
+// objects up to 16 bytes without allocating
+TEST (objectFactory, test_13)
+{
+  SKIP_WITHOUT_ALLOCATION_TRACKING();
+  using namespace object_factory::object_counter;
+
+  class A final : public objectCounter<A>
+  {
+    int _x{};
+    int _y{};
+    int _z{};
+
+   public:
+    explicit
+    A() noexcept = default;
+
+    explicit
+    A(const int x, const int y, const int z) noexcept
+    :
+    _x(x),
+    _y(y),
+    _z(z)
+    {}
+  };
+
+  using Object = std::unique_ptr<A>;
+
+  // one allocation for the object, nothing else
+  {
+    object_factory::allocation_tracker::allocationBudget budget {1, sizeof(A)};
+    Object o = object_factory::createUniquePtr<A>();
+    ASSERT_TRUE(budget.withinBudget());
+    ASSERT_EQ(1, budget.allocations());
+    ASSERT_EQ(sizeof(A), budget.bytes());
+    o.reset();
+    ASSERT_EQ(1, budget.deallocations());
+  }
+
+  // creating and copying a factory whose captured arguments fit in std::function
+  object_factory::objectFactoryFun<A> objectFactoryFun {};
+  ASSERT_TRUE(allocates(0, [&objectFactoryFun] ()
+  {
+    objectFactoryFun = object_factory::createObjectFactoryFun<A, const int, const int, const int>(99, 88, 77);
+  }));
+  ASSERT_TRUE(allocates(0, [&objectFactoryFun] ()
+  {
+    object_factory::objectFactoryFun<A> copy {objectFactoryFun};
+  }));
+
+  // calling a factory: one allocation per object
+  ASSERT_TRUE(allocates(1, [&objectFactoryFun] ()
+  {
+    Object o = objectFactoryFun();
+  }));
+  ASSERT_TRUE(allocates(10, [&objectFactoryFun] ()
+  {
+    for (int i {1}; i <= 10; ++i)
+    {
+      Object o = objectFactoryFun();
+    }
+  }));
+
+  // a prototype factory allocates the prototype and its function object once
+  object_factory::objectFactoryFun<A> prototypeFactoryFun {};
+  ASSERT_TRUE(allocates(2, [&prototypeFactoryFun] ()
+  {
+    prototypeFactoryFun = object_factory::createPrototypeFactoryFun<A>(1, 2, 3);
+  }));
+  ASSERT_TRUE(allocates(1, [&prototypeFactoryFun] ()
+  {
+    Object o = prototypeFactoryFun();
+  }));
+
+  // a pooled factory allocates only when its arena needs a new chunk
+  object_factory::objectPool<A> pool {1, &object_factory::simulatedNumaNode, 16};
+  object_factory::pooledObjectFactoryFun<A> pooledFactoryFun {};
+  ASSERT_TRUE(allocates(0, [&pool, &pooledFactoryFun] ()
+  {
+    pooledFactoryFun = object_factory::createPooledObjectFactoryFun<A>(pool);
+  }));
+  ASSERT_TRUE(allocates(1, [&pooledFactoryFun] ()
+  {
+    // the arena chunk list; chunks are mapped, not allocated
+    object_factory::pooledUniquePtr<A> o = pooledFactoryFun();
+  }));
+  ASSERT_TRUE(allocates(0, [&pooledFactoryFun] ()
+  {
+    std::array<object_factory::pooledUniquePtr<A>, 16> objects {};
+    for (auto&& o : objects)
+    {
+      o = pooledFactoryFun();
+    }
+  }));
+}
+
+// test the streaming factory building objects from the records of a file
+TEST (objectFactory, test_14)
+{
+  using namespace object_factory::object_counter;
+
+  class A final : public objectCounter<A>
+  {
+    std::string _name{};
+
+   public:
+    explicit
+    A(std::string_view record)
+    :
+    _name(record)
+    {}
+
+    const std::string& get_name() const noexcept
+    {
+      return _name;
+    }
+  };
+
+  const std::string fileName {"/tmp/object-factory-test_14-" + std::to_string(::getpid())};
+  const std::vector<std::string> names {"alpha", "", "gamma", "a much longer record than the others"};
+
+  // length prefixed records
+  {
+    std::ofstream ofs(fileName, std::ios::binary | std::ios::trunc);
+    for (auto&& name : names)
+    {
+      const auto size {static_cast<std::uint32_t>(name.size())};
+      const char prefix[4] {static_cast<char>(size & 0xff),
+                            static_cast<char>((size >> 8) & 0xff),
+                            static_cast<char>((size >> 16) & 0xff),
+                            static_cast<char>((size >> 24) & 0xff)};
+      ofs.write(prefix, sizeof(prefix));
+      ofs << name;
+    }
+  }
+  {
+    // lazily, one object at a time
+    object_factory::recordStreamFactory<A> factory {fileName, object_factory::recordFormat::lengthPrefixed};
+    for (auto&& name : names)
+    {
+      std::unique_ptr<A> o {factory.next()};
+      ASSERT_NE(nullptr, o);
+      ASSERT_EQ(name, o->get_name());
+    }
+    ASSERT_EQ(nullptr, factory.next());
+    ASSERT_EQ(names.size(), factory.recordsRead());
+  }
+  {
+    // in batches
+    object_factory::recordStreamFactory<A> factory {fileName, object_factory::recordFormat::lengthPrefixed};
+    std::vector<std::size_t> batchSizes {};
+    std::vector<std::string> names_read {};
+    const std::size_t n {factory.forEachBatch(3, [&] (std::vector<std::unique_ptr<A>>& batch)
+    {
+      batchSizes.push_back(batch.size());
+      for (auto&& o : batch)
+      {
+        names_read.push_back(o->get_name());
+      }
+    })};
+    ASSERT_EQ(names.size(), n);
+    ASSERT_EQ(std::vector<std::size_t>({3, 1}), batchSizes);
+    ASSERT_EQ(names, names_read);
+  }
+  ASSERT_EQ(0, A::getObjectsAliveCounter());
+  ASSERT_EQ(2 * names.size(), A::getObjectsCreatedCounter());
+
+  // fixed length records with a custom make function
+  {
+    std::ofstream ofs(fileName, std::ios::binary | std::ios::trunc);
+    ofs << "0001" << "0002" << "0003";
+  }
+  {
+    object_factory::recordStreamFactory<A> factory {fileName,
+                                                    object_factory::recordFormat::fixedLength,
+                                                    4,
+                                                    [] (std::string_view record)
+                                                    {
+                                                      return object_factory::createUniquePtr<A>(record.substr(2));
+                                                    }};
+    std::vector<std::unique_ptr<A>> batch {};
+    ASSERT_EQ(2, factory.nextBatch(batch, 2));
+    ASSERT_EQ(1, factory.nextBatch(batch, 2));
+    ASSERT_EQ(0, factory.nextBatch(batch, 2));
+    ASSERT_EQ(3, batch.size());
+    ASSERT_EQ("01", batch[0]->get_name());
+    ASSERT_EQ("03", batch[2]->get_name());
+  }
+
+  // truncated last record
+  {
+    std::ofstream ofs(fileName, std::ios::binary | std::ios::app);
+    ofs << "00";
+  }
+  {
+    object_factory::recordStreamFactory<A> factory {fileName, object_factory::recordFormat::fixedLength, 4};
+    std::vector<std::unique_ptr<A>> batch {};
+    ASSERT_THROW(factory.nextBatch(batch, 10), std::runtime_error);
+    ASSERT_EQ(3, batch.size());
+  }
+
+  std::remove(fileName.c_str());
+  ASSERT_THROW(object_factory::recordStreamFactory<A>(fileName, object_factory::recordFormat::fixedLength, 4),
+               std::system_error);
+}
+
+// test the inline polymorphic handle: small derived objects are stored inline
+TEST (objectFactory, test_15)
+{
+  using namespace object_factory::object_counter;
+
+  class Shape
+  {
+   public:
+    virtual ~Shape() = default;
+    virtual int area() const noexcept = 0;
+  };
+
+  class Square final : public Shape, public objectCounter<Square>
+  {
+    int _side{};
+
+   public:
+    explicit
+    Square(const int side) noexcept
+    :
+    _side(side)
+    {}
+
+    int area() const noexcept override
+    {
+      return _side * _side;
+    }
+  };
+
+  class BigShape final : public Shape, public objectCounter<BigShape>
+  {
+    std::array<int, 64> _cells{};
+
+   public:
+    explicit
+    BigShape(const int value) noexcept
+    {
+      _cells.fill(value);
+    }
+
+    int area() const noexcept override
+    {
+      return _cells[0] * static_cast<int>(_cells.size());
+    }
+  };
+
+  constexpr std::size_t N {32};
+  using Handle = object_factory::inlinePoly<Shape, N>;
+  static_assert(Handle::fitsInline<Square>);
+  static_assert(!Handle::fitsInline<BigShape>);
+
+  {
+    object_factory::inlinePolyFactoryFun<Shape, N> squareFactoryFun =
+            object_factory::createInlinePolyFactoryFun<Shape, N, Square>(3);
+    object_factory::inlinePolyFactoryFun<Shape, N> bigFactoryFun =
+            object_factory::createInlinePolyFactoryFun<Shape, N, BigShape>(2);
+
+    // inline objects need no allocation, large ones one
+    ASSERT_TRUE(allocatesIfTracked(0, [&squareFactoryFun] ()
+    {
+      Handle h = squareFactoryFun();
+      ASSERT_TRUE(h.isInline());
+      ASSERT_EQ(9, h->area());
+    }));
+    ASSERT_TRUE(allocatesIfTracked(1, [&bigFactoryFun] ()
+    {
+      Handle h = bigFactoryFun();
+      ASSERT_FALSE(h.isInline());
+      ASSERT_EQ(128, h->area());
+    }));
+    ASSERT_EQ(1, Square::getObjectsCreatedCounter());
+    ASSERT_EQ(0, Square::getObjectsAliveCounter());
+    ASSERT_EQ(0, Square::getMoveConstructionsCounter());
+
+    Square::resetCounters();
+    BigShape::resetCounters();
+
+    Handle s = squareFactoryFun();
+    Handle b = bigFactoryFun();
+
+    // moving an inline object move constructs it into the target handle
+    Handle s2 {std::move(s)};
+    ASSERT_FALSE(s);
+    ASSERT_TRUE(s2.isInline());
+    ASSERT_EQ(9, s2->area());
+    ASSERT_EQ(1, Square::getMoveConstructionsCounter());
+    ASSERT_EQ(1, Square::getObjectsAliveCounter());
+    ASSERT_EQ(2, Square::getObjectsCreatedCounter());
+    ASSERT_EQ(1, Square::getObjectsDestroyedCounter());
+
+    // moving a heap object just moves the pointer
+    Shape* big {b.get()};
+    Handle b2 {std::move(b)};
+    ASSERT_EQ(big, b2.get());
+    ASSERT_EQ(0, BigShape::getMoveConstructionsCounter());
+    ASSERT_EQ(1, BigShape::getObjectsAliveCounter());
+
+    // move assignment destroys the object held by the target
+    s2 = std::move(b2);
+    ASSERT_FALSE(s2.isInline());
+    ASSERT_EQ(128, s2->area());
+    ASSERT_EQ(0, Square::getObjectsAliveCounter());
+
+    std::vector<Handle> v {};
+    for (int i {1}; i <= 10; ++i)
+    {
+      v.push_back(squareFactoryFun());
+    }
+    for (auto&& h : v)
+    {
+      ASSERT_EQ(9, h->area());
+    }
+
+    // with an alignment below a pointer's the storage still holds heap ones
+    using Packed = object_factory::inlinePoly<Shape, N, 1>;
+    Packed p {std::in_place_type<BigShape>, 1};
+    ASSERT_FALSE(p.isInline());
+    ASSERT_EQ(64, Packed {std::move(p)}->area());
+  }
+
+  auto [objectsCreated, objectsAlive, objectsDestroyed, tooManyDestructions] = Square::getObjectCounters();
+  ASSERT_EQ(0, objectsAlive);
+  ASSERT_EQ(objectsCreated, objectsDestroyed);
+  ASSERT_EQ(false, tooManyDestructions);
+  ASSERT_EQ(0, BigShape::getObjectsAliveCounter());
+  ASSERT_EQ(false, BigShape::getTooManyDestructionsFlag());
+}
+
+// test the interning factory: identical immutable objects are shared
+TEST (objectFactory, test_16)
+{
+  using namespace object_factory::object_counter;
+
+  class Point final : public objectCounter<Point>
+  {
+    int _x{};
+    int _y{};
+    std::string _label{};
+
+   public:
+    Point(const int x, const int y, const std::string& label)
+    :
+    _x(x),
+    _y(y),
+    _label(label)
+    {}
+
+    int get_x() const noexcept
+    {
+      return _x;
+    }
+    const std::string& get_label() const noexcept
+    {
+      return _label;
+    }
+  };
+
+  using Interner = object_factory::objectInterner<Point, int, int, std::string>;
+  Interner::handle survivor {};
+
+  {
+    Interner interner {};
+    object_factory::internedObjectFactoryFun<Point> pointFactoryFun =
+            object_factory::createInternedObjectFactoryFun(interner, 99, 88, "p");
+
+    auto p1 = pointFactoryFun();
+    auto p2 = pointFactoryFun();
+    auto p3 = interner.intern(99, 88, "p");
+    auto q = interner.intern(1, 2, "q");
+    ASSERT_EQ(p1.get(), p2.get());
+    ASSERT_EQ(p1.get(), p3.get());
+    ASSERT_NE(p1.get(), q.get());
+    ASSERT_EQ(99, p1->get_x());
+    ASSERT_EQ("q", q->get_label());
+    ASSERT_EQ(2, Point::getObjectsAliveCounter());
+    ASSERT_EQ(2, interner.size());
+
+    {
+      auto [lookups, hits, alive, bytesSaved] = interner.getInternCounters();
+      ASSERT_EQ(4, lookups);
+      ASSERT_EQ(2, hits);
+      ASSERT_EQ(2, alive);
+      ASSERT_EQ(2 * sizeof(Point), bytesSaved);
+      ASSERT_DOUBLE_EQ(2.0, interner.getDedupRatio());
+    }
+
+    // the entry is evicted with its last handle, then built again
+    q.reset();
+    ASSERT_EQ(1, Point::getObjectsAliveCounter());
+    ASSERT_EQ(1, interner.size());
+    q = interner.intern(1, 2, "q");
+    ASSERT_EQ(2, Point::getObjectsCreatedCounter() - Point::getObjectsDestroyedCounter());
+
+    // concurrent lookups of the same arguments share one instance
+    std::vector<std::thread> threads {};
+    std::vector<Interner::handle> handles(8);
+    for (std::size_t t {0}; t < handles.size(); ++t)
+    {
+      threads.emplace_back([&interner, &handles, t] ()
+      {
+        for (int i {0}; i < 1'000; ++i)
+        {
+          handles[t] = interner.intern(i % 10, 0, "t");
+        }
+      });
+    }
+    for (auto&& t : threads)
+    {
+      t.join();
+    }
+    for (auto&& h : handles)
+    {
+      ASSERT_EQ(handles[0].get(), h.get());
+    }
+
+    // handles may outlive the interner
+    survivor = interner.intern(5, 5, "late");
+  }
+
+  ASSERT_EQ(1, Point::getObjectsAliveCounter());
+  ASSERT_EQ("late", survivor->get_label());
+  survivor.reset();
+  ASSERT_EQ(0, Point::getObjectsAliveCounter());
+  ASSERT_EQ(false, Point::getTooManyDestructionsFlag());
+}
+
+// test the alive object quotas: fail fast, block with timeout, shed
+TEST (objectFactory, test_17)
+{
+  using namespace object_factory::object_counter;
+  using namespace std::chrono_literals;
+
+  class Job final : public objectCounter<Job>
+  {
+    int _id{};
+
+   public:
+    explicit
+    Job(const int id) noexcept
+    :
+    _id(id)
+    {}
+
+    int get_id() const noexcept
+    {
+      return _id;
+    }
+  };
+
+  // fail fast
+  {
+    object_factory::aliveQuota quota {2};
+    object_factory::quotaObjectFactoryFun<Job> jobFactoryFun =
+            object_factory::createQuotaObjectFactoryFun<Job>(quota, 7);
+
+    auto j1 = jobFactoryFun();
+    auto j2 = jobFactoryFun();
+    ASSERT_EQ(7, j2->get_id());
+    ASSERT_THROW(jobFactoryFun(), object_factory::quotaExceeded);
+    ASSERT_EQ(2, Job::getObjectsAliveCounter());
+    j1.reset();
+    auto j3 = jobFactoryFun();
+
+    auto [admitted, rejected, blocked, shedCalls, alive] = quota.getQuotaCounters();
+    ASSERT_EQ(3, admitted);
+    ASSERT_EQ(1, rejected);
+    ASSERT_EQ(0, blocked);
+    ASSERT_EQ(0, shedCalls);
+    ASSERT_EQ(2, alive);
+  }
+  ASSERT_EQ(0, Job::getObjectsAliveCounter());
+
+  // block with timeout
+  {
+    object_factory::aliveQuota quota {1, object_factory::quotaPolicy::block, 20ms};
+    object_factory::quotaObjectFactoryFun<Job> jobFactoryFun =
+            object_factory::createQuotaObjectFactoryFun<Job>(quota, 1);
+
+    auto j1 = jobFactoryFun();
+    ASSERT_THROW(jobFactoryFun(), object_factory::quotaExceeded);
+
+    // a blocked creator gets the slot of an object destroyed by another thread
+    object_factory::aliveQuota longQuota {1, object_factory::quotaPolicy::block, 10s};
+    object_factory::quotaObjectFactoryFun<Job> longJobFactoryFun =
+            object_factory::createQuotaObjectFactoryFun<Job>(longQuota, 2);
+    auto j2 = longJobFactoryFun();
+    std::future<object_factory::quotaUniquePtr<Job>> f {std::async(std::launch::async, longJobFactoryFun)};
+    while ( 0 == std::get<2>(longQuota.getQuotaCounters()) )
+    {
+      std::this_thread::yield();
+    }
+    j2.reset();
+    auto j3 = f.get();
+    ASSERT_EQ(2, j3->get_id());
+    ASSERT_EQ(1, std::get<4>(longQuota.getQuotaCounters()));
+  }
+
+  // shed: the shedding function destroys cached objects to make room
+  {
+    std::vector<object_factory::quotaUniquePtr<Job>> cache {};
+    object_factory::aliveQuota quota {4,
+                                      object_factory::quotaPolicy::shed,
+                                      0ms,
+                                      [&cache] () { cache.clear(); }};
+    object_factory::quotaObjectFactoryFun<Job> jobFactoryFun =
+            object_factory::createQuotaObjectFactoryFun<Job>(quota, 3);
+
+    for (int i {0}; i < 10; ++i)
+    {
+      cache.push_back(jobFactoryFun());
+      ASSERT_LE(Job::getObjectsAliveCounter(), 4);
+    }
+    ASSERT_EQ(2, std::get<3>(quota.getQuotaCounters()));
+    ASSERT_EQ(0, std::get<1>(quota.getQuotaCounters()));
+  }
+
+  // many threads never exceed the quota
+  {
+    object_factory::aliveQuota quota {3, object_factory::quotaPolicy::block, 10s};
+    object_factory::quotaObjectFactoryFun<Job> jobFactoryFun =
+            object_factory::createQuotaObjectFactoryFun<Job>(quota, 4);
+    std::atomic<bool> exceeded {false};
+    std::vector<std::thread> threads {};
+    for (int t {0}; t < 8; ++t)
+    {
+      threads.emplace_back([&jobFactoryFun, &exceeded] ()
+      {
+        for (int i {0}; i < 1'000; ++i)
+        {
+          auto j = jobFactoryFun();
+          if ( Job::getObjectsAliveCounter() > 3 )
+          {
+            exceeded = true;
+          }
+        }
+      });
+    }
+    for (auto&& t : threads)
+    {
+      t.join();
+    }
+    ASSERT_FALSE(exceeded);
+    ASSERT_EQ(0, std::get<4>(quota.getQuotaCounters()));
+  }
+
+  ASSERT_THROW(object_factory::aliveQuota(1, object_factory::quotaPolicy::shed), std::invalid_argument);
+  ASSERT_EQ(0, Job::getObjectsAliveCounter());
+  ASSERT_EQ(false, Job::getTooManyDestructionsFlag());
+}
+
+// test the huge page backing of the pool chunks, with fallback to regular memory
+TEST (objectFactory, test_18)
+{
+  using namespace object_factory::object_counter;
+
+  class Particle final : public objectCounter<Particle>
+  {
+    double _x{};
+    double _y{};
+
+   public:
+    Particle(const double x, const double y) noexcept
+    :
+    _x(x),
+    _y(y)
+    {}
+
+    double get_x() const noexcept
+    {
+      return _x;
+    }
+  };
+
+  const std::size_t slotsPerChunk {64};
+
+  // regular chunks hold exactly slotsPerChunk slots
+  {
+    object_factory::objectPool<Particle> pool {1, &object_factory::simulatedNumaNode, slotsPerChunk};
+    std::vector<object_factory::pooledUniquePtr<Particle>> v {};
+    for (std::size_t i {0}; i < 2 * slotsPerChunk; ++i)
+    {
+      v.push_back(object_factory::createPooledUniquePtr<Particle>(pool, 1.0, 2.0));
+    }
+    auto [hugeTLB, transparentHugePages, regular] = pool.getChunkCounters();
+    ASSERT_EQ(0, hugeTLB);
+    ASSERT_EQ(0, transparentHugePages);
+    ASSERT_EQ(2, regular);
+  }
+
+  // huge page chunks, whatever backing the host allows, hold at least a huge
+  // page worth of slots
+  {
+    object_factory::objectPool<Particle> pool {1,
+                                               &object_factory::simulatedNumaNode,
+                                               slotsPerChunk,
+                                               object_factory::chunkBacking::hugePages};
+    object_factory::pooledObjectFactoryFun<Particle> particleFactoryFun =
+            object_factory::createPooledObjectFactoryFun<Particle>(pool, 3.0, 4.0);
+    std::vector<object_factory::pooledUniquePtr<Particle>> v {};
+    for (std::size_t i {0}; i < 4 * slotsPerChunk; ++i)
+    {
+      v.push_back(particleFactoryFun());
+    }
+    double sum {0.0};
+    for (auto&& p : v)
+    {
+      sum += p->get_x();
+    }
+    ASSERT_DOUBLE_EQ(3.0 * static_cast<double>(v.size()), sum);
+
+    auto [hugeTLB, transparentHugePages, regular] = pool.getChunkCounters();
+    auto [allocations, localFrees, remoteFrees, chunks] = pool.getPoolCounters();
+    ASSERT_EQ(chunks, hugeTLB + transparentHugePages + regular);
+    if ( 0 == regular )
+    {
+      ASSERT_EQ(1, chunks);
+    }
+    else
+    {
+      ASSERT_EQ(4, chunks);
+    }
+  }
+
+  // the chunk allocation itself
+  {
+    const object_factory::poolChunk chunk {object_factory::allocatePoolChunk(100, 64, object_factory::chunkBacking::hugePages)};
+    ASSERT_NE(nullptr, chunk.address_);
+    ASSERT_EQ(0, reinterpret_cast<std::uintptr_t>(chunk.address_) % 64);
+    if ( object_factory::chunkKind::regular == chunk.kind_ )
+    {
+      ASSERT_LE(100, chunk.size_);
+      ASSERT_EQ(0, chunk.size_ % static_cast<std::size_t>(::sysconf(_SC_PAGESIZE)));
+    }
+    else
+    {
+      ASSERT_EQ(object_factory::hugePageSize, chunk.size_);
+      ASSERT_EQ(0, reinterpret_cast<std::uintptr_t>(chunk.address_) % object_factory::hugePageSize);
+    }
+    // madvise(MADV_HUGEPAGE) succeeds even with transparent huge pages disabled
+    if ( !object_factory::transparentHugePagesEnabled() )
+    {
+      ASSERT_NE(object_factory::chunkKind::transparentHugePages, chunk.kind_);
+    }
+    static_cast<char*>(chunk.address_)[chunk.size_ - 1] = 1;
+    object_factory::freePoolChunk(chunk);
+  }
+
+  // regular chunks are fresh mappings, aligned beyond the page size if needed
+  {
+    const object_factory::poolChunk chunk {object_factory::allocatePoolChunk(100, 1 << 16, object_factory::chunkBacking::regular)};
+    ASSERT_EQ(object_factory::chunkKind::regular, chunk.kind_);
+    ASSERT_EQ(0, reinterpret_cast<std::uintptr_t>(chunk.address_) % (1 << 16));
+    ASSERT_EQ(0, static_cast<char*>(chunk.address_)[0]);
+    object_factory::freePoolChunk(chunk);
+  }
+
+  ASSERT_EQ(0, Particle::getObjectsAliveCounter());
+  ASSERT_EQ(false, Particle::getTooManyDestructionsFlag());
+}
+
+// test the fixed capacity factory: no heap allocations, exhaustion reported
+TEST (objectFactory, test_19)
+{
+  using namespace object_factory::object_counter;
+
+  class Order final : public objectCounter<Order>
+  {
+    long _id{};
+    double _price{};
+
+   public:
+    Order(const long id, const double price) noexcept
+    :
+    _id(id),
+    _price(price)
+    {}
+
+    long get_id() const noexcept
+    {
+      return _id;
+    }
+  };
+
+  class Throwing final
+  {
+   public:
+    explicit
+    Throwing(const bool fail)
+    {
+      if ( fail )
+      {
+        throw std::runtime_error("construction failed");
+      }
+    }
+  };
+
+  static constexpr std::size_t capacity {4};
+  using Factory = object_factory::staticObjectFactory<Order, capacity>;
+  static Factory factory {};
+
+  static_assert(noexcept(factory.create(1L, 1.0)));
+  static_assert(!noexcept(std::declval<object_factory::staticObjectFactory<Throwing, 1>&>().create(true)));
+  static_assert(Factory::capacity() == capacity);
+
+  object_factory::staticObjectFactoryFun<Order, capacity> orderFactoryFun =
+          object_factory::createStaticObjectFactoryFun(factory, 7L, 1.5);
+
+  ASSERT_TRUE(allocatesIfTracked(0, [&orderFactoryFun] ()
+  {
+    std::array<Factory::handle, capacity + 1> handles {};
+    for (auto&& h : handles)
+    {
+      h = orderFactoryFun();
+    }
+    for (std::size_t i {0}; i < capacity; ++i)
+    {
+      ASSERT_TRUE(handles[i]);
+      ASSERT_EQ(7, handles[i]->get_id());
+    }
+    // exhausted
+    ASSERT_FALSE(handles[capacity]);
+    ASSERT_EQ(capacity, Order::getObjectsAliveCounter());
+
+    // a released slot is reused at once
+    Order* second {handles[1].get()};
+    handles[1].reset();
+    handles[capacity] = factory.create(8L, 2.5);
+    ASSERT_EQ(second, handles[capacity].get());
+    ASSERT_EQ(8, handles[capacity]->get_id());
+
+    // moves transfer the slot
+    Factory::handle h {std::move(handles[0])};
+    ASSERT_FALSE(handles[0]);
+    ASSERT_EQ(7, h->get_id());
+    handles[0] = std::move(h);
+  }));
+
+  auto [cap, inUse, highWater, exhaustions] = factory.getStaticFactoryCounters();
+  ASSERT_EQ(capacity, cap);
+  ASSERT_EQ(0, inUse);
+  ASSERT_EQ(capacity, highWater);
+  ASSERT_EQ(1, exhaustions);
+  ASSERT_EQ(0, Order::getObjectsAliveCounter());
+
+  // a constructor throwing gives the slot back
+  object_factory::staticObjectFactory<Throwing, 1> throwingFactory {};
+  ASSERT_THROW(throwingFactory.create(true), std::runtime_error);
+  ASSERT_TRUE(throwingFactory.create(false));
+  ASSERT_EQ(0, std::get<1>(throwingFactory.getStaticFactoryCounters()));
+
+  // concurrent creations never hand out more than the capacity
+  std::vector<std::thread> threads {};
+  for (int t {0}; t < 8; ++t)
+  {
+    threads.emplace_back([] ()
+    {
+      for (int i {0}; i < 10'000; ++i)
+      {
+        auto h = factory.create(static_cast<long>(i), 0.0);
+        if ( h )
+        {
+          ASSERT_EQ(i, h->get_id());
+        }
+      }
+    });
+  }
+  for (auto&& t : threads)
+  {
+    t.join();
+  }
+  ASSERT_EQ(0, std::get<1>(factory.getStaticFactoryCounters()));
+  ASSERT_EQ(capacity, std::get<2>(factory.getStaticFactoryCounters()));
+  ASSERT_EQ(0, Order::getObjectsAliveCounter());
+  ASSERT_EQ(false, Order::getTooManyDestructionsFlag());
+}
+
+// test the counter contexts attributing object churn to the work causing it
+TEST (objectFactory, test_20)
+{
+  using namespace object_factory::object_counter;
+
+  class Message final : public objectCounter<Message>
+  {
+    int _size{};
+
+   public:
+    explicit
+    Message(const int size) noexcept
+    :
+    _size(size)
+    {}
+
+    int get_size() const noexcept
+    {
+      return _size;
+    }
+  };
+
+  class Buffer final : public objectCounter<Buffer>
+  {};
+
+  counterContext request {"request"};
+  counterContext parse {"parse", &request};
+  counterContext render {"render", &request};
+
+  ASSERT_EQ(nullptr, activeCounterContext());
+  // not attributed to any context
+  auto outside = object_factory::createUniquePtr<Message>(0);
+
+  {
+    counterContextScope requestScope {request};
+    ASSERT_EQ(&request, activeCounterContext());
+    auto m = object_factory::createUniquePtr<Message>(1);
+
+    {
+      counterContextScope parseScope {parse};
+      std::vector<Message> v {};
+      v.reserve(10);
+      for (int i {0}; i < 10; ++i)
+      {
+        v.emplace_back(i);
+      }
+      Message copy {v[0]};
+      auto [created, destroyed, peak] = parse.getContextCounters();
+      ASSERT_EQ(11, created);
+      ASSERT_EQ(0, destroyed);
+      ASSERT_EQ(11, peak);
+    }
+    ASSERT_EQ(&request, activeCounterContext());
+
+    // work handed over to another thread stays in the submitter's context
+    counterContext* context {activeCounterContext()};
+    std::thread worker([context, &render] ()
+    {
+      counterContextScope scope {context};
+      counterContextScope renderScope {render};
+      for (int i {0}; i < 5; ++i)
+      {
+        Buffer b {};
+      }
+    });
+    worker.join();
+
+    // suspended attribution
+    {
+      counterContextScope none {nullptr};
+      Message ignored {2};
+    }
+  }
+  ASSERT_EQ(nullptr, activeCounterContext());
+
+  {
+    auto [created, destroyed, peak] = parse.getContextCounters();
+    ASSERT_EQ(11, created);
+    ASSERT_EQ(11, destroyed);
+    ASSERT_EQ(11, peak);
+  }
+  {
+    auto [created, destroyed, peak] = render.getContextCounters();
+    ASSERT_EQ(5, created);
+    ASSERT_EQ(5, destroyed);
+    ASSERT_EQ(1, peak);
+  }
+  {
+    // 1 + 11 + 5 created, all destroyed, at most 12 alive at once
+    auto [created, destroyed, peak] = request.getContextCounters();
+    ASSERT_EQ(17, created);
+    ASSERT_EQ(17, destroyed);
+    ASSERT_EQ(12, peak);
+  }
+
+  // an object created in a context and destroyed outside of it
+  {
+    counterContextScope scope {render};
+    outside = object_factory::createUniquePtr<Message>(3);
+  }
+  outside.reset();
+  ASSERT_EQ(6, std::get<0>(render.getContextCounters()));
+  ASSERT_EQ(6, std::get<1>(render.getContextCounters()));
+
+  request.resetCounters();
+  ASSERT_EQ(0, std::get<0>(request.getContextCounters()));
+  ASSERT_EQ(0, Message::getObjectsAliveCounter());
+  ASSERT_EQ(false, Message::getTooManyDestructionsFlag());
+}
+
+// test the creator -> destroyer thread matrix
+TEST (objectFactory, test_21)
+{
+  using namespace object_factory::object_counter;
+
+  class Untracked final : public objectCounter<Untracked>
+  {};
+
+  class Task final : public objectCounter<Task, unsigned long, true>
+  {
+    int _id{};
+
+   public:
+    explicit
+    Task(const int id) noexcept
+    :
+    _id(id)
+    {}
+  };
+
+  // thread tracking off costs nothing
+  static_assert(sizeof(objectCounter<Untracked>) == sizeof(void*));
+  static_assert(std::is_empty_v<creatorThread<false>>);
+
+  Task::resetCounters();
+  const std::size_t self {trackedThreadIndex()};
+  ASSERT_EQ(self, trackedThreadIndex());
+  ASSERT_LT(self, maxTrackedThreads);
+
+  // created and destroyed here
+  for (int i {0}; i < 3; ++i)
+  {
+    auto t = object_factory::createUniquePtr<Task>(i);
+  }
+
+  // created by a producer, destroyed here
+  std::vector<std::unique_ptr<Task>> produced {};
+  std::size_t producer {};
+  std::thread([&produced, &producer] ()
+  {
+    producer = trackedThreadIndex();
+    for (int i {0}; i < 4; ++i)
+    {
+      produced.push_back(object_factory::createUniquePtr<Task>(i));
+    }
+  }).join();
+  ASSERT_NE(self, producer);
+
+  // a copy made here is created here
+  {
+    const Task copy {*produced[0]};
+  }
+  produced.clear();
+
+  // created here, destroyed by a consumer
+  auto consumed = object_factory::createUniquePtr<Task>(9);
+  std::size_t consumer {};
+  std::thread([&consumed, &consumer] ()
+  {
+    consumer = trackedThreadIndex();
+    consumed.reset();
+  }).join();
+
+  {
+    const threadMatrixSnapshot matrix {Task::getThreadMatrix()};
+    ASSERT_EQ(4, matrix.count(self, self));
+    ASSERT_EQ(4, matrix.count(producer, self));
+    ASSERT_EQ(1, matrix.count(self, consumer));
+    ASSERT_EQ(0, matrix.count(self, producer));
+    ASSERT_EQ(4, matrix.localFrees_);
+    ASSERT_EQ(5, matrix.remoteFrees_);
+    ASSERT_EQ(0, matrix.unattributedFrees_);
+    ASSERT_DOUBLE_EQ(5.0 / 9.0, matrix.remoteFreeRatio());
+  }
+
+  // frees between overflow threads are unattributed, overflow and tracked
+  // threads are certainly different
+  Task::resetCounters();
+  std::size_t index {};
+  std::unique_ptr<Task> fromOverflow {};
+  do
+  {
+    std::thread([&index, &fromOverflow] ()
+    {
+      index = trackedThreadIndex();
+      if ( overflowThreadIndex == index )
+      {
+        if ( nullptr == fromOverflow )
+        {
+          fromOverflow = object_factory::createUniquePtr<Task>(1);
+        }
+        else
+        {
+          fromOverflow.reset();
+          auto t = object_factory::createUniquePtr<Task>(2);
+        }
+      }
+    }).join();
+  } while ( nullptr != fromOverflow || overflowThreadIndex != index );
+  ASSERT_EQ(maxTrackedThreads, trackedThreadCount());
+  {
+    auto toOverflow = object_factory::createUniquePtr<Task>(3);
+    std::thread([&toOverflow] () { toOverflow.reset(); }).join();
+  }
+  {
+    const threadMatrixSnapshot matrix {Task::getThreadMatrix()};
+    ASSERT_EQ(2, matrix.count(overflowThreadIndex, overflowThreadIndex));
+    ASSERT_EQ(2, matrix.unattributedFrees_);
+    ASSERT_EQ(1, matrix.remoteFrees_);
+    ASSERT_EQ(0, matrix.localFrees_);
+    ASSERT_DOUBLE_EQ(1.0, matrix.remoteFreeRatio());
+  }
+
+  ASSERT_EQ(false, Task::getTooManyDestructionsFlag());
+
+  Task::resetCounters();
+  ASSERT_EQ(0, Task::getThreadMatrix().localFrees_);
+  ASSERT_DOUBLE_EQ(0.0, Task::getThreadMatrix().remoteFreeRatio());
+  ASSERT_EQ(false, Task::getTooManyDestructionsFlag());
+}
+
 #pragma clang diagnostic pop
 // END: ignore the warnings when compiled with clang up to here